@@ -4,10 +4,111 @@
 #include <stdint.h>
 #include <stddef.h>
 
+/* COBS/ZPE codes: run of 223 bytes, block followed by a pair of zeros */
+#define COBS_ZPE_RUN	0xE0
+#define COBS_ZPE_PAIR	0xE1
+
+/* Largest number of bytes "length" bytes are stuffed into, without the
+ * delimiter. Constant for constant "length", so buffers can be static. */
+#define COBS_MAX_ENCODED_SIZE(length)		((length) + (length)/254 + 1)
+#define COBS_ZPE_MAX_ENCODED_SIZE(length)	\
+	((length) + (length)/(COBS_ZPE_RUN - 1) + 1)
+
+/* Stuffing variants */
+typedef enum
+{
+	COBS_CODEC_COBS,		// consistent overhead byte stuffing
+	COBS_CODEC_COBSR,		// COBS/R, last byte may replace final code
+	COBS_CODEC_ZPE			// COBS/ZPE, zero pair elimination
+} cobs_codec_t;
+
+/* Called with payload bytes in stream order while they are stuffed or
+ * unstuffed, e.g. to feed a CRC in the same pass */
+typedef void (*cobs_hook_t)(void *arg, const uint8_t *data, size_t length);
+
+/* Source segment of scatter-gather encoding */
+typedef struct
+{
+	const void	*data;
+	size_t		size;
+} cobs_segment_t;
+
+/* Incremental encoder state */
+typedef struct
+{
+	uint8_t		*output;		// buffer for encoded frame
+	size_t		size;			// ring size, 0 for a linear buffer
+	size_t		start;			// position of frame in the ring
+	size_t		length;			// number of bytes written to output
+	size_t		code_index;		// position of code of current block
+	cobs_codec_t	codec;
+	uint8_t		block;			// data bytes in current block
+	uint8_t		pair;			// block ended with zero, may get a pair
+	cobs_hook_t	hook;			// sees input on the way, NULL if none
+	void		*hook_arg;
+} cobs_encoder_t;
+
+/* Result of feeding bytes to the streaming decoder */
+typedef enum
+{
+	COBS_DECODER_MORE,		// frame is not complete, waiting for more bytes
+	COBS_DECODER_FRAME,		// delimiter reached, frame decoded
+	COBS_DECODER_ERROR		// delimiter reached, frame was malformed
+} cobs_decoder_status_t;
+
+/* Streaming decoder state */
+typedef struct
+{
+	uint8_t		*output;	// buffer for decoded frame
+	size_t		size;		// size of output buffer
+	size_t		length;		// number of decoded bytes in output buffer
+	cobs_codec_t	codec;
+	uint8_t		code;		// code of current block, 0 at frame start
+	uint8_t		count;		// data bytes left in current block
+	uint8_t		zeros;		// zeros following current block
+	uint8_t		error;		// frame is dropped until next delimiter
+} cobs_decoder_t;
+
 size_t cobs_encode(const uint8_t * restrict input, size_t length,
 	uint8_t * restrict output);
-	
+
+size_t cobs_encode_v(const cobs_segment_t *segments, size_t count,
+	uint8_t * restrict output);
+
+size_t cobs_max_encoded_size(cobs_codec_t codec, size_t length);
+
+size_t cobs_codec_encode(cobs_codec_t codec, const uint8_t * restrict input,
+	size_t length, uint8_t * restrict output);
+
+size_t cobs_codec_decode(cobs_codec_t codec, const uint8_t *input,
+	size_t length, uint8_t *output);
+
+size_t cobs_codec_decode_hook(cobs_codec_t codec, const uint8_t *input,
+	size_t length, uint8_t *output, cobs_hook_t hook, void *arg);
+
+void cobs_encoder_init(cobs_encoder_t *encoder, cobs_codec_t codec,
+	uint8_t *output);
+
+void cobs_encoder_feed(cobs_encoder_t *encoder, const uint8_t *input,
+	size_t length);
+
+void cobs_encoder_init_ring(cobs_encoder_t *encoder, cobs_codec_t codec,
+	uint8_t *ring, size_t size, size_t start);
+
+void cobs_encoder_hook(cobs_encoder_t *encoder, cobs_hook_t hook,
+	void *arg);
+
+size_t cobs_encoder_finish(cobs_encoder_t *encoder);
+
 size_t cobs_decode(const uint8_t * restrict input, size_t length,
 	uint8_t * restrict output);
 
+void cobs_decoder_init(cobs_decoder_t *decoder, cobs_codec_t codec,
+	uint8_t *output, size_t size);
+
+int cobs_decoder_pending(const cobs_decoder_t *decoder);
+
+cobs_decoder_status_t cobs_decoder_feed(cobs_decoder_t *decoder,
+	const uint8_t *input, size_t length, size_t *consumed);
+
 #endif /* COBS_H */
@@ -0,0 +1,85 @@
+#ifndef CRC_FREERTOS_H
+#define CRC_FREERTOS_H
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/*----------------------------------------------------------------------
+  Includes
+----------------------------------------------------------------------*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* HAL */
+#include "stm32f1xx_hal.h"
+/* FreeRTOS */
+#include "FreeRTOS.h"
+#include "semphr.h"
+
+/*----------------------------------------------------------------------
+  Defines
+----------------------------------------------------------------------*/
+
+/* CRC-32/MPEG-2: polynomial 0x04C11DB7, initial value 0xFFFFFFFF,
+ * no reflection, no final XOR, bytes are processed in stream order */
+#define CRC_FREERTOS_POLY		0x04C11DB7UL
+
+/*----------------------------------------------------------------------
+  Data type declarations
+----------------------------------------------------------------------*/
+
+/* Status codes */
+typedef enum
+{
+	CRC_FREERTOS_OK			= 0x00U,	// Success
+	CRC_FREERTOS_ERR		= 0x01U,	// Error
+	CRC_FREERTOS_BUSY		= 0x03U,	// Device is busy
+	CRC_FREERTOS_EXIST		= 0x05U		// CRC already initialized
+} crc_freertos_status;
+
+/* CRC calculation in progress */
+typedef struct __packed
+{
+	/* bytes that do not fill a whole word yet, first byte is MSB.
+	 * Software CRC of crc_freertos_begin_software() */
+	uint32_t	tail;
+	uint8_t		tail_size;
+	/* calculated without CRC unit and its mutex */
+	uint8_t		software;
+} crc_freertos_t;
+
+/*----------------------------------------------------------------------
+  Functions
+----------------------------------------------------------------------*/
+
+/* Enable CRC unit clock and create its mutex */
+crc_freertos_status crc_freertos_init(void);
+
+/* Take CRC unit and reset it, data are accumulated until the end */
+crc_freertos_status crc_freertos_begin(crc_freertos_t* crc,
+	TickType_t mutex_timeout);
+
+/* Start CRC calculated in software, CRC unit stays free. For callers
+ * that must not wait for the unit */
+void crc_freertos_begin_software(crc_freertos_t* crc);
+
+/* Feed data to CRC unit word by word */
+void crc_freertos_update(crc_freertos_t* crc, const void* data,
+	size_t data_size);
+
+/* Process remaining bytes, give back CRC unit and return CRC */
+uint32_t crc_freertos_end(crc_freertos_t* crc);
+
+/* Give back CRC unit, calculation goes on in software. For callers
+ * that wait for more data in the middle of a calculation */
+void crc_freertos_release(crc_freertos_t* crc);
+
+/* Calculate CRC of buffer */
+crc_freertos_status crc_freertos_calc(const void* data, size_t data_size,
+	uint32_t* result, TickType_t mutex_timeout);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* CRC_FREERTOS_H */
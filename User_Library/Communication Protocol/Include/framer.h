@@ -0,0 +1,152 @@
+#ifndef FRAMER_H
+#define FRAMER_H
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/*----------------------------------------------------------------------
+  Includes
+----------------------------------------------------------------------*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "cobs.h"
+#include "slip.h"
+#include "length_prefix.h"
+
+/*----------------------------------------------------------------------
+  Defines
+----------------------------------------------------------------------*/
+
+/* Returned by decode for a malformed frame */
+#define FRAMER_INVALID		((size_t) -1)
+
+/* Returned by decode for nothing between two delimiters, no frame */
+#define FRAMER_EMPTY		((size_t) -2)
+
+/* Framer without delimiter */
+#define FRAMER_NO_DELIMITER	(-1)
+
+/*----------------------------------------------------------------------
+  Data type declarations
+----------------------------------------------------------------------*/
+
+/* Result of feeding bytes to the streaming decoder */
+typedef enum
+{
+	FRAMER_MORE,		// frame is not complete, waiting for more bytes
+	FRAMER_FRAME,		// frame complete and decoded
+	FRAMER_ERROR		// frame complete, but malformed
+} framer_status;
+
+typedef struct framer framer_t;
+
+/* Called with payload bytes in stream order while a frame is encoded
+ * or decoded, e.g. to feed a CRC in the same pass */
+typedef void (*framer_hook_t)(void *arg, const uint8_t *data, size_t length);
+
+/* Encoder state of any framer */
+typedef struct
+{
+	const framer_t	*framer;
+	framer_hook_t	hook;
+	void			*hook_arg;
+	union
+	{
+		cobs_encoder_t			cobs;
+		slip_encoder_t			slip;
+		length_prefix_encoder_t	length_prefix;
+	};
+} framer_encoder_t;
+
+/* Output fields every decoder state starts with */
+typedef struct
+{
+	uint8_t		*output;	// buffer for decoded frame
+	size_t		size;		// size of output buffer
+	size_t		length;		// number of decoded bytes in output buffer
+} framer_buffer_t;
+
+/* Decoder state of any framer */
+typedef struct
+{
+	const framer_t	*framer;
+	union
+	{
+		framer_buffer_t			buffer;
+		cobs_decoder_t			cobs;
+		slip_decoder_t			slip;
+		length_prefix_decoder_t	length_prefix;
+	};
+} framer_decoder_t;
+
+/* Framing engine */
+struct framer
+{
+	/* Byte ending every frame, FRAMER_NO_DELIMITER if none */
+	int16_t		delimiter;
+	/* Largest encoded size of "length" bytes, delimiter included */
+	size_t		(*max_encoded_size)(size_t length);
+	/* Start frame of "length" bytes in ring of "size" bytes at "start",
+	 * size 0 for a linear buffer */
+	void		(*encoder_init)(framer_encoder_t *encoder, uint8_t *output,
+					size_t size, size_t start, size_t length);
+	void		(*encoder_feed)(framer_encoder_t *encoder,
+					const uint8_t *input, size_t length);
+	/* Pass input to hook while it is encoded. NULL if the framer
+	 * can not, input is then passed right before it is encoded */
+	void		(*encoder_hook)(framer_encoder_t *encoder,
+					framer_hook_t hook, void *arg);
+	/* Returns encoded length, delimiter included */
+	size_t		(*encoder_finish)(framer_encoder_t *encoder);
+	void		(*decoder_init)(framer_decoder_t *decoder, uint8_t *output,
+					size_t size);
+	int			(*decoder_pending)(const framer_decoder_t *decoder);
+	framer_status	(*decoder_feed)(framer_decoder_t *decoder,
+					const uint8_t *input, size_t length, size_t *consumed);
+	/* Decode one frame, delimiter excluded, in place if "output" is
+	 * "input", passing the output to "hook" unless it is NULL.
+	 * Returns FRAMER_EMPTY for length 0, FRAMER_INVALID for a
+	 * malformed frame. NULL if frames do not decode in place. */
+	size_t		(*decode)(const uint8_t *input, size_t length,
+					uint8_t *output, framer_hook_t hook, void *arg);
+};
+
+/*----------------------------------------------------------------------
+  Framers
+----------------------------------------------------------------------*/
+
+extern const framer_t framer_cobs;			// COBS, noisy lines
+extern const framer_t framer_cobsr;			// COBS/R
+extern const framer_t framer_cobs_zpe;		// COBS/ZPE, zero heavy data
+extern const framer_t framer_slip;			// SLIP, empty frames are lost
+extern const framer_t framer_length_prefix;	// up to 65535 bytes, bulk data
+
+/*----------------------------------------------------------------------
+  Functions
+----------------------------------------------------------------------*/
+
+void framer_encoder_init(framer_encoder_t *encoder, const framer_t *framer,
+	uint8_t *output, size_t size, size_t start, size_t length);
+
+void framer_encoder_hook(framer_encoder_t *encoder, framer_hook_t hook,
+	void *arg);
+
+void framer_encoder_feed(framer_encoder_t *encoder, const uint8_t *input,
+	size_t length);
+
+size_t framer_encoder_finish(framer_encoder_t *encoder);
+
+void framer_decoder_init(framer_decoder_t *decoder, const framer_t *framer,
+	uint8_t *output, size_t size);
+
+int framer_decoder_pending(const framer_decoder_t *decoder);
+
+framer_status framer_decoder_feed(framer_decoder_t *decoder,
+	const uint8_t *input, size_t length, size_t *consumed);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* FRAMER_H */
@@ -0,0 +1,72 @@
+#ifndef LENGTH_PREFIX_H
+#define LENGTH_PREFIX_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Frame layout: length (2 bytes, little endian), header check (low
+ * byte of CRC-16 of length), payload, CRC-16 of payload (2 bytes,
+ * little endian). CRC-16/CCITT-FALSE: polynomial 0x1021, initial
+ * value 0xFFFF, no reflection, no final XOR.
+ */
+#define LENGTH_PREFIX_HEADER_SIZE	3
+#define LENGTH_PREFIX_CRC_SIZE		2
+#define LENGTH_PREFIX_MAX			0xFFFF
+
+/* Number of bytes a frame of "length" payload bytes takes */
+#define LENGTH_PREFIX_MAX_ENCODED_SIZE(length)	\
+	(LENGTH_PREFIX_HEADER_SIZE + (length) + LENGTH_PREFIX_CRC_SIZE)
+
+/* Result of feeding bytes to the streaming decoder */
+typedef enum
+{
+	LENGTH_PREFIX_DECODER_MORE,		// frame is not complete
+	LENGTH_PREFIX_DECODER_FRAME,	// frame received, CRC matches
+	LENGTH_PREFIX_DECODER_ERROR		// frame received, CRC mismatch
+} length_prefix_decoder_status;
+
+/* Incremental encoder state */
+typedef struct
+{
+	uint8_t		*output;		// buffer for encoded frame
+	size_t		size;			// ring size, 0 for a linear buffer
+	size_t		index;			// position of next byte in the ring
+	size_t		length;			// number of bytes written to output
+	uint16_t	crc;			// CRC of payload fed so far
+} length_prefix_encoder_t;
+
+/* Streaming decoder state */
+typedef struct
+{
+	uint8_t		*output;	// buffer for decoded frame
+	size_t		size;		// size of output buffer
+	size_t		length;		// number of payload bytes in output buffer
+	size_t		expected;	// payload length from header
+	uint16_t	crc;		// CRC of payload received so far
+	uint8_t		field[LENGTH_PREFIX_HEADER_SIZE];	// header or CRC
+	uint8_t		count;		// bytes of field received
+	uint8_t		state;		// header, payload or CRC is received
+} length_prefix_decoder_t;
+
+uint16_t length_prefix_crc(uint16_t crc, const uint8_t *data, size_t length);
+
+size_t length_prefix_max_encoded_size(size_t length);
+
+void length_prefix_encoder_init(length_prefix_encoder_t *encoder,
+	uint8_t *output, size_t size, size_t start, size_t length);
+
+void length_prefix_encoder_feed(length_prefix_encoder_t *encoder,
+	const uint8_t *input, size_t length);
+
+size_t length_prefix_encoder_finish(length_prefix_encoder_t *encoder);
+
+void length_prefix_decoder_init(length_prefix_decoder_t *decoder,
+	uint8_t *output, size_t size);
+
+int length_prefix_decoder_pending(const length_prefix_decoder_t *decoder);
+
+length_prefix_decoder_status length_prefix_decoder_feed(
+	length_prefix_decoder_t *decoder, const uint8_t *input, size_t length,
+	size_t *consumed);
+
+#endif /* LENGTH_PREFIX_H */
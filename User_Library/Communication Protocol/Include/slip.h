@@ -0,0 +1,64 @@
+#ifndef SLIP_H
+#define SLIP_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* SLIP special characters, RFC 1055 */
+#define SLIP_END		0xC0
+#define SLIP_ESC		0xDB
+#define SLIP_ESC_END	0xDC
+#define SLIP_ESC_ESC	0xDD
+
+/* Largest number of bytes "length" bytes are escaped into, END
+ * included. Constant for constant "length", so buffers can be static. */
+#define SLIP_MAX_ENCODED_SIZE(length)	(2*(length) + 1)
+
+/* Result of feeding bytes to the streaming decoder */
+typedef enum
+{
+	SLIP_DECODER_MORE,		// frame is not complete, waiting for more bytes
+	SLIP_DECODER_FRAME,		// END reached, frame decoded
+	SLIP_DECODER_ERROR		// END reached, frame was malformed
+} slip_decoder_status;
+
+/* Incremental encoder state */
+typedef struct
+{
+	uint8_t		*output;		// buffer for encoded frame
+	size_t		size;			// ring size, 0 for a linear buffer
+	size_t		index;			// position of next byte in the ring
+	size_t		length;			// number of bytes written to output
+} slip_encoder_t;
+
+/* Streaming decoder state */
+typedef struct
+{
+	uint8_t		*output;	// buffer for decoded frame
+	size_t		size;		// size of output buffer
+	size_t		length;		// number of decoded bytes in output buffer
+	uint8_t		escape;		// previous byte was ESC
+	uint8_t		error;		// frame is dropped until next END
+} slip_decoder_t;
+
+size_t slip_max_encoded_size(size_t length);
+
+void slip_encoder_init(slip_encoder_t *encoder, uint8_t *output,
+	size_t size, size_t start);
+
+void slip_encoder_feed(slip_encoder_t *encoder, const uint8_t *input,
+	size_t length);
+
+size_t slip_encoder_finish(slip_encoder_t *encoder);
+
+size_t slip_decode(const uint8_t *input, size_t length, uint8_t *output);
+
+void slip_decoder_init(slip_decoder_t *decoder, uint8_t *output,
+	size_t size);
+
+int slip_decoder_pending(const slip_decoder_t *decoder);
+
+slip_decoder_status slip_decoder_feed(slip_decoder_t *decoder,
+	const uint8_t *input, size_t length, size_t *consumed);
+
+#endif /* SLIP_H */
@@ -9,15 +9,177 @@
 ----------------------------------------------------------------------*/
 #include "stm32f1xx_hal.h"
 #include "uart_freertos.h"
+#include "cobs.h"
+#include "framer.h"
+#include "crc_freertos.h"
 /* FreeRTOS */
 #include "FreeRTOS.h"
+#include "task.h"
 #include "queue.h"
+#include "semphr.h"
 #include "cmsis_os.h"
 
+/*----------------------------------------------------------------------
+  Defines
+----------------------------------------------------------------------*/
+
+/* Size of CRC appended to payload in integrity mode */
+#define UART_COBS_CRC_SIZE		4
+
+/* Size of channel index preceding payload on multiplexed link */
+#define UART_COBS_CHANNEL_SIZE	1
+
+/* Size of frame type leading every frame with flow control or
+ * reliable delivery */
+#define UART_COBS_TYPE_SIZE		1
+
+/* Size of sequence number following type of data frame in reliable
+ * delivery */
+#define UART_COBS_SEQ_SIZE		1
+
+/* Size of ACK and NACK payload, next sequence number expected */
+#define UART_COBS_ACK_SIZE		1
+
+/* Size of reset payload, oldest sequence number of window and data
+ * frames sent little endian */
+#define UART_COBS_RESET_SIZE	3
+
+/* Size of credit frame payload, receive limit and data frames sent
+ * little endian */
+#define UART_COBS_CREDIT_SIZE	4
+
+/* Size of baud rate frame payload, rate little endian */
+#define UART_COBS_BAUD_SIZE		4
+
+/* Credit period of service configured without one */
+#ifndef UART_COBS_CREDIT_PERIOD
+#define UART_COBS_CREDIT_PERIOD	pdMS_TO_TICKS(100)
+#endif
+
+/* Retransmit window and timeout of service configured without them,
+ * window is 128 frames at most */
+#ifndef UART_COBS_TX_WINDOW
+#define UART_COBS_TX_WINDOW		8
+#endif
+#ifndef UART_COBS_RETRANSMIT_TIMEOUT
+#define UART_COBS_RETRANSMIT_TIMEOUT	pdMS_TO_TICKS(50)
+#endif
+
+/* Time for check of new baud rate before both ends fall back, of
+ * service configured without one */
+#ifndef UART_COBS_BAUD_TIMEOUT
+#define UART_COBS_BAUD_TIMEOUT	pdMS_TO_TICKS(200)
+#endif
+
+/* Number of TX priority lanes, queued frames of higher lane are sent
+ * first, lane 0 is bulk data */
+#ifndef UART_COBS_TX_LANES
+#define UART_COBS_TX_LANES		2
+#endif
+
+/* Attempts to start a TX transfer, a tick apart, before the frame is
+ * dropped and counted in tx_errors */
+#ifndef UART_COBS_TX_RETRIES
+#define UART_COBS_TX_RETRIES	3
+#endif
+
+/* Message type of stats frame, first byte of its payload. Payload of
+ * UART_COBS_STATS_SIZE bytes: type, UART_COBS_STATS_VERSION, then the
+ * fields of uart_cobs_stats_t in order, little endian. Counters take
+ * 4 bytes, rx_held_max and tx_queued_max 2 bytes, and each lane its
+ * frames, wait_total and wait_max in 4 bytes each. */
+#ifndef UART_COBS_STATS_TYPE
+#define UART_COBS_STATS_TYPE	0xFF
+#endif
+#define UART_COBS_STATS_VERSION	1
+#define UART_COBS_STATS_SIZE	(2 + 11*4 + 2*2 + UART_COBS_TX_LANES*3*4)
+
+/* Static storage sizes, allocations are rounded up to FreeRTOS byte
+ * alignment */
+#define UART_COBS_STATIC_ALIGN(size)	\
+	(((size) + portBYTE_ALIGNMENT - 1) & ~((size_t) portBYTE_ALIGNMENT_MASK))
+
+/* Largest type, sequence number, channel and CRC added to payload */
+#define UART_COBS_STATIC_OVERHEAD	(UART_COBS_TYPE_SIZE + UART_COBS_SEQ_SIZE \
+	+ UART_COBS_CHANNEL_SIZE + UART_COBS_CRC_SIZE)
+
+/* Largest encoded frame of static services with delimiter, COBS and
+ * COBS/R. Define it project wide for other framers:
+ * (COBS_ZPE_MAX_ENCODED_SIZE(length) + 1), SLIP_MAX_ENCODED_SIZE or
+ * LENGTH_PREFIX_MAX_ENCODED_SIZE. A framer needing more than this
+ * runs out of arena and ends in Error_Handler(). */
+#ifndef UART_COBS_STATIC_MAX_ENCODED_SIZE
+#define UART_COBS_STATIC_MAX_ENCODED_SIZE(length)	\
+	(COBS_MAX_ENCODED_SIZE(length) + 1)
+#endif
+
+#define UART_COBS_STATIC_FRAME_SIZE(frame_size)	\
+	UART_COBS_STATIC_MAX_ENCODED_SIZE((frame_size) + UART_COBS_STATIC_OVERHEAD)
+
+/* RX task: frame queues of "depth" frames in total, one per channel or
+ * output queue if "channels" is 0, free queue and a slot more. Add
+ * staging buffer of framers that do not decode in place */
+#define UART_COBS_RX_STATIC_SIZE(frame_size, depth, channels)	\
+	(((channels) ? (channels) : 1) \
+		*(UART_COBS_STATIC_ALIGN(sizeof(StaticQueue_t)) + portBYTE_ALIGNMENT) \
+	+ UART_COBS_STATIC_ALIGN((depth)*sizeof(uart_cobs_frame_t)) \
+	+ UART_COBS_STATIC_ALIGN(sizeof(StaticQueue_t)) \
+	+ UART_COBS_STATIC_ALIGN(((depth) + 1)*sizeof(void *)) \
+	+ UART_COBS_STATIC_ALIGN((depth) + 1) \
+	+ UART_COBS_STATIC_ALIGN(((depth) + 1) \
+		*UART_COBS_STATIC_FRAME_SIZE(frame_size)))
+/* Staging buffer of framers that do not decode in place, COBS/ZPE
+ * and length prefix */
+#define UART_COBS_RX_STAGING_STATIC_SIZE(frame_size)	\
+	UART_COBS_STATIC_ALIGN(UART_COBS_STATIC_FRAME_SIZE(frame_size))
+
+/* TX task: lane queues, semaphores and two frame buffers. Add burst
+ * buffers of burst mode, ring of DMA ring mode, window of reliable
+ * delivery and semaphore of baud rate negotiation */
+#define UART_COBS_TX_STATIC_SIZE(frame_size, depth)	\
+	(UART_COBS_TX_LANES*(UART_COBS_STATIC_ALIGN(sizeof(StaticQueue_t)) \
+		+ UART_COBS_STATIC_ALIGN((depth)*sizeof(uart_cobs_tx_frame_t))) \
+	+ 2*UART_COBS_STATIC_ALIGN(sizeof(StaticSemaphore_t)) \
+	+ 2*UART_COBS_STATIC_ALIGN(UART_COBS_STATIC_FRAME_SIZE(frame_size)))
+#define UART_COBS_TX_BURST_STATIC_SIZE(burst_size)	\
+	(2*UART_COBS_STATIC_ALIGN(burst_size))
+#define UART_COBS_TX_RING_STATE_SIZE	(9*sizeof(void *))
+#define UART_COBS_TX_RING_STATIC_SIZE(ring_size)	\
+	(UART_COBS_STATIC_ALIGN(UART_COBS_TX_RING_STATE_SIZE) \
+	+ UART_COBS_STATIC_ALIGN(ring_size) \
+	+ UART_COBS_STATIC_ALIGN(sizeof(StaticSemaphore_t)))
+#define UART_COBS_TX_WINDOW_STATIC_SIZE(frame_size, window)	\
+	(UART_COBS_STATIC_ALIGN((window)*sizeof(uart_cobs_tx_frame_t)) \
+	+ UART_COBS_STATIC_ALIGN((window)*(frame_size)))
+#define UART_COBS_TX_BAUD_STATIC_SIZE	\
+	UART_COBS_STATIC_ALIGN(sizeof(StaticSemaphore_t))
+
+/* Declare static storage "name" of service, arena sizes in bytes from
+ * the sizes above and task stacks in bytes */
+#define UART_COBS_STATIC_DEF(name, rx_size, tx_size, rx_stack_bytes, \
+	tx_stack_bytes)	\
+	static uint8_t name##_rx_buffer[UART_COBS_STATIC_ALIGN(rx_size)] \
+		__attribute__((aligned(portBYTE_ALIGNMENT))); \
+	static uint8_t name##_tx_buffer[UART_COBS_STATIC_ALIGN(tx_size)] \
+		__attribute__((aligned(portBYTE_ALIGNMENT))); \
+	static StackType_t name##_rx_stack[(rx_stack_bytes)/sizeof(StackType_t)]; \
+	static StackType_t name##_tx_stack[(tx_stack_bytes)/sizeof(StackType_t)]; \
+	static uart_cobs_static_t name = { \
+		.rx = {name##_rx_buffer, sizeof(name##_rx_buffer), 0}, \
+		.tx = {name##_tx_buffer, sizeof(name##_tx_buffer), 0}, \
+		.rx_stack = name##_rx_stack, \
+		.rx_stack_size = sizeof(name##_rx_stack), \
+		.tx_stack = name##_tx_stack, \
+		.tx_stack_size = sizeof(name##_tx_stack) \
+	}
+
 /*----------------------------------------------------------------------
   Data type declarations
 ----------------------------------------------------------------------*/
 
+/* In DMA mode TX task takes tx_mutex of UART when it starts and holds
+ * it for its lifetime, transfers are started without it. Nothing else
+ * may transmit on that UART. */
 typedef enum
 {
 	UART_COBS_POLLING,
@@ -25,20 +187,268 @@ typedef enum
 	UART_COBS_DMA
 } uart_cobs_mode_t;
 
+/* Frame integrity check, CRC-32/MPEG-2 of payload is appended
+ * to payload little endian before encoding. It is calculated while
+ * frames are encoded and decoded, with every framer. Frame split
+ * between two receptions goes on in software. */
+typedef enum
+{
+	UART_COBS_CRC_NONE,
+	UART_COBS_CRC32
+} uart_cobs_crc_t;
+
+/* Frame type on link with flow control, reliable delivery or baud
+ * rate negotiation */
+typedef enum
+{
+	UART_COBS_TYPE_DATA,		// payload, takes one credit
+	UART_COBS_TYPE_CREDIT,		// receive limit of sender
+	UART_COBS_TYPE_ACK,			// data frames received up to sequence number
+	UART_COBS_TYPE_NACK,		// same as ACK, frames after it are to be resent
+	UART_COBS_TYPE_BAUD,		// baud rate proposed
+	UART_COBS_TYPE_BAUD_ACK,	// rate taken, checked or confirmed, 0 - refused
+	UART_COBS_TYPE_BAUD_CHECK,	// check of proposer at new rate
+	UART_COBS_TYPE_RESET,		// session start of reliable delivery
+	UART_COBS_TYPE_RESET_ACK	// reset taken, session state of answer
+} uart_cobs_type_t;
+
+/* Receiver behaviour when every slot is held by consumers. A channel
+ * holding its queue depth of slots drops its new frames either way,
+ * single task mode drops them as well since TX runs in its task */
+typedef enum
+{
+	UART_COBS_RX_BLOCK,		// wait for uart_cobs_release()
+	UART_COBS_RX_DROP		// drop new frame and count it
+} uart_cobs_rx_full_t;
+
 typedef struct __packed
 {
 	void* data;
 	size_t size;
 } uart_cobs_frame_t;
 
+/* Called by TX task once "data" of a frame is encoded and no longer
+ * referenced, "data" is the buffer or the segment array passed */
+typedef void (*uart_cobs_tx_done_t)(void* arg, const void* data);
+
+/* Frame to transmit, "size" bytes or "count" segments at "data" */
+typedef struct __packed
+{
+	const void* data;
+	size_t size;
+	size_t count;
+	uart_cobs_tx_done_t done;
+	void* arg;
+	uint8_t channel;
+	uint8_t lane;
+	TickType_t queued;		// set by uart_cobs_send_frame()
+	uint8_t type;			// set by uart_cobs_send_frame()
+	uint8_t seq;			// set by TX task in reliable delivery
+} uart_cobs_tx_frame_t;
+
+/* Handler of received message, runs in RX task. Message starts with
+ * its type byte and is valid until the handler returns */
+typedef void (*uart_cobs_handler_t)(void* arg, const void* data,
+	size_t size);
+
+/* Dispatcher entry, message of "type" is passed to handler or, without
+ * handler, to queue of uart_cobs_frame_t */
+typedef struct uart_cobs_dispatch
+{
+	uint8_t						type;
+	uart_cobs_handler_t			handler;
+	void*						arg;
+	QueueHandle_t				queue;
+	struct uart_cobs_dispatch	*next;
+	/* set by uart_cobs_register(), entry is freed on unregister */
+	uint8_t						allocated;
+	/* set by uart_cobs_unregister(), RX task clears it once the entry
+	 * is unlinked and out of use */
+	volatile uint8_t			removed;
+} uart_cobs_dispatch_t;
+
+/* Queue wait of frames of one TX lane, ticks from being queued until
+ * TX task starts encoding them */
+typedef struct __packed
+{
+	uint32_t			frames;
+	uint32_t			wait_total;
+	TickType_t			wait_max;
+} uart_cobs_tx_lane_stats_t;
+
+/* Link statistics, counters wrap. Each counter is written by one task
+ * only, never from an interrupt, read them with uart_cobs_get_stats() */
+typedef struct __packed
+{
+	/* bytes received from UART and frames handed to consumers */
+	uint32_t			rx_bytes;
+	uint32_t			rx_frames;
+	/* bytes encoded for UART and data frames sent first time */
+	uint32_t			tx_bytes;
+	uint32_t			tx_frames;
+	/* frames failing framing or CRC check, nothing between two
+	 * delimiters is no frame and not counted */
+	uint32_t			decode_errors;
+	uint32_t			crc_errors;
+	/* frames without slot or queue room, partial frames dropped after
+	 * gap timeout */
+	uint32_t			rx_dropped;
+	uint32_t			rx_resyncs;
+	uint32_t			retransmits;
+	/* high-water marks of slots held by consumers and of frames
+	 * queued in lanes */
+	uint16_t			rx_held_max;
+	uint16_t			tx_queued_max;
+	/* ticks a frame waited for credit or room in window */
+	uint32_t			tx_stall;
+	/* transfers UART failed to start or complete. DMA ring transfers
+	 * are retried until they start, two buffer DMA transfers
+	 * UART_COBS_TX_RETRIES times, frames failing otherwise are lost */
+	uint32_t			tx_errors;
+	uart_cobs_tx_lane_stats_t	tx_lanes[UART_COBS_TX_LANES];
+} uart_cobs_stats_t;
+
+/* Logical channel, frames carry index of channel as first byte. Queue
+ * depth is also the number of slots the channel may hold */
+typedef struct __packed
+{
+	uint8_t				queue_depth;
+	QueueHandle_t		queue;
+	/* slots queued or held by consumers */
+	volatile uint8_t	held;
+} uart_cobs_channel_t;
+
+/* Memory taken by a task at start, Error_Handler() if it runs out */
+typedef struct
+{
+	uint8_t				*buffer;
+	size_t				size;
+	size_t				used;
+} uart_cobs_arena_t;
+
+/* Static storage of service, see UART_COBS_STATIC_DEF() */
+typedef struct
+{
+	uart_cobs_arena_t	rx;
+	uart_cobs_arena_t	tx;
+	StaticTask_t		rx_task;
+	StaticTask_t		tx_task;
+	StackType_t			*rx_stack;
+	uint32_t			rx_stack_size;
+	StackType_t			*tx_stack;
+	uint32_t			tx_stack_size;
+} uart_cobs_static_t;
+
 typedef struct __packed
 {
 	uart_freertos_t		*huart;
 	size_t				max_frame_size;
 	uint8_t				queue_depth;
 	uart_cobs_mode_t	mode;
-	QueueHandle_t		input_queue;
+	uart_cobs_crc_t		crc;
+	/* framing engine, NULL - COBS */
+	const framer_t		*framer;
+	/* queues, buffers and task stacks, NULL - FreeRTOS heap. Service
+	 * with storage takes dispatcher entries from
+	 * uart_cobs_register_static() only */
+	uart_cobs_static_t	*storage;
+	/* DMA mode: frames are encoded into a ring of this size drained by
+	 * chained DMA transfers, 0 - frames are staged in two buffers */
+	size_t				tx_ring_size;
+	/* Without ring: frames queued within burst delay of the first one
+	 * are sent in one transfer of up to burst size bytes, 0 - frame
+	 * by frame */
+	size_t				tx_burst_size;
+	TickType_t			tx_burst_delay;
+	/* logical channels, NULL - frames are not tagged and received
+	 * into output queue */
+	uart_cobs_channel_t	*channels;
+	uint8_t				channel_count;
+	/* credit based flow control, both ends must enable it. Data frame
+	 * is sent only while the peer has a free slot for it. Receive
+	 * limit is advertised each credit period and when the peer runs
+	 * low on credit, period 0 - UART_COBS_CREDIT_PERIOD. Credit frame
+	 * carries data frames sent by its end as well, the receiver takes
+	 * them over as its count, so miscounted frames and a restart of
+	 * either end are made up for by the next credit frame */
+	uint8_t				flow_control;
+	TickType_t			credit_period;
+	/* data frames the peer accepts, counted from start of this end */
+	volatile uint16_t	tx_limit;
+	uint16_t			tx_sent;
+	/* data frames received, counted as the peer sends them, and
+	 * receive limit last advertised */
+	volatile uint16_t	rx_count;
+	uint16_t			rx_advertised;
+	TickType_t			credit_tick;
+	/* reliable delivery, both ends must enable it. Data frames carry
+	 * sequence number and stay in a window of tx_window frames until
+	 * the peer acknowledges them. They are sent again on NACK or after
+	 * retransmit timeout, the receiver delivers them in order only.
+	 * Window and timeout 0 - defaults. It needs CRC, Error_Handler()
+	 * otherwise. An end starting sends reset each retransmit timeout
+	 * and no data until the peer answers, both ends then take the
+	 * sequence number and count of data frames of the other. Frames
+	 * in flight when an end restarts may be lost or delivered twice */
+	uint8_t				reliable;
+	uint8_t				tx_window;
+	TickType_t			retransmit_timeout;
+	/* next sequence number expected by peer */
+	volatile uint8_t	tx_acked;
+	/* requests of RX task to TX task */
+	volatile uint8_t	tx_control;
+	uint8_t				rx_expected;
+	uint8_t				rx_nacked;
+	/* reset handshake, set by RX task once sequence number of peer is
+	 * taken and once reset of this end is answered */
+	volatile uint8_t	rx_synced;
+	volatile uint8_t	tx_synced;
+	/* baud rate negotiation, both ends must enable it. Either end
+	 * proposes a rate up to baud_max, the peer acknowledges it and both
+	 * switch. Rates USART can not run at are refused. Proposer sends
+	 * check frames at the new rate and confirms the answer, each end
+	 * falls back to the old rate unless it gets the answer or the
+	 * confirm within baud timeout. Max 0 - off, timeout 0 -
+	 * UART_COBS_BAUD_TIMEOUT */
+	uint32_t			baud_max;
+	TickType_t			baud_timeout;
+	/* rate of uart_cobs_set_baud() while it runs, 0 - none */
+	volatile uint32_t	baud_request;
+	/* rate of last baud frame of peer, set by RX task */
+	volatile uint32_t	baud_peer;
+	/* rate negotiated, 0 - failed, given with baud done by TX task */
+	uint32_t			baud_result;
+	SemaphoreHandle_t	baud_done;
+	/* given by RX task on credit, ACK, NACK and baud frames */
+	SemaphoreHandle_t	tx_event;
+	/* TX priority lanes, each of queue depth */
+	QueueHandle_t		input_queue[UART_COBS_TX_LANES];
+	SemaphoreHandle_t	tx_pending;
+	/* single task mode, set by uart_cobs_service_task(), NULL - RX and
+	 * TX tasks */
+	TaskHandle_t		task;
 	QueueHandle_t		output_queue;
+	/* registered message types, other messages go to output or
+	 * channel queue */
+	uart_cobs_dispatch_t	*dispatch;
+	/* an entry waits for RX task to unlink it */
+	volatile uint8_t	dispatch_removed;
+	/* partial frame is dropped when no byte follows within this time,
+	 * RX task only, 0 - waits for the rest forever */
+	TickType_t			rx_gap_timeout;
+	/* received frame slots released by consumers */
+	uart_cobs_rx_full_t	rx_full;
+	QueueHandle_t		free_queue;
+	uint8_t				*rx_pool;
+	size_t				rx_slot_size;
+	size_t				rx_slots;
+	/* per slot, owner of slot held by consumer until released,
+	 * channel + 1 or 1 without channels, 0 - not held */
+	uint8_t				*rx_owned;
+	/* stats frame, see UART_COBS_STATS_TYPE, is sent in lane 0 on
+	 * channel 0 each period if it fits max frame size, 0 - off */
+	TickType_t			stats_period;
+	uart_cobs_stats_t	stats;
 } uart_cobs_service_t;
 
 /*----------------------------------------------------------------------
@@ -46,19 +456,60 @@ typedef struct __packed
 ----------------------------------------------------------------------*/
 
 /* send and receive of data */
+size_t uart_cobs_send_frame(uart_cobs_service_t* h,
+	const uart_cobs_tx_frame_t* frame, TickType_t timeout);
+size_t uart_cobs_send_frame_from_isr(uart_cobs_service_t* h,
+	const uart_cobs_tx_frame_t* frame, BaseType_t* pxHigherPriorityTaskWoken);
+size_t uart_cobs_send_from_isr(uart_cobs_service_t* h, const void* data,
+	size_t size, BaseType_t* pxHigherPriorityTaskWoken);
 size_t uart_cobs_send(uart_cobs_service_t* h, void* data, size_t size,
 	TickType_t timeout);
+size_t uart_cobs_sendv(uart_cobs_service_t* h, const cobs_segment_t* segments,
+	size_t count, TickType_t timeout);
+size_t uart_cobs_send_channel(uart_cobs_service_t* h, uint8_t channel,
+	const void* data, size_t size, TickType_t timeout);
+size_t uart_cobs_send_lane(uart_cobs_service_t* h, uint8_t lane,
+	const void* data, size_t size, TickType_t timeout);
+size_t uart_cobs_send_async(uart_cobs_service_t* h, const void* data,
+	size_t size, uart_cobs_tx_done_t done, void* arg, TickType_t timeout);
+size_t uart_cobs_sendv_async(uart_cobs_service_t* h,
+	const cobs_segment_t* segments, size_t count, uart_cobs_tx_done_t done,
+	void* arg, TickType_t timeout);
+void uart_cobs_tx_done_notify(void* arg, const void* data);
 size_t uart_cobs_recv(uart_cobs_service_t* h, void** data, TickType_t timeout);
+size_t uart_cobs_recv_channel(uart_cobs_service_t* h, uint8_t channel,
+	void** data, TickType_t timeout);
+BaseType_t uart_cobs_release(uart_cobs_service_t* h, void* data);
+void uart_cobs_get_stats(uart_cobs_service_t* h, uart_cobs_stats_t* stats);
+BaseType_t uart_cobs_set_baud(uart_cobs_service_t* h, uint32_t baud);
+
+/* dispatch of received messages by type byte */
+BaseType_t uart_cobs_register(uart_cobs_service_t* h, uint8_t type,
+	uart_cobs_handler_t handler, void* arg);
+BaseType_t uart_cobs_register_queue(uart_cobs_service_t* h, uint8_t type,
+	QueueHandle_t queue);
+BaseType_t uart_cobs_register_static(uart_cobs_service_t* h,
+	uart_cobs_dispatch_t* entry);
+void uart_cobs_unregister(uart_cobs_service_t* h, uint8_t type);
 
 /* task create */
 osThreadId uart_cobs_service_rx_create(char *name, osPriority priority,
 	uint32_t instances, uint32_t stack_size, uart_cobs_service_t* h);
 osThreadId uart_cobs_service_tx_create(char *name, osPriority priority,
 	uint32_t instances, uint32_t stack_size, uart_cobs_service_t* h);
+osThreadId uart_cobs_service_rx_create_static(char *name, osPriority priority,
+	uart_cobs_service_t* h);
+osThreadId uart_cobs_service_tx_create_static(char *name, osPriority priority,
+	uart_cobs_service_t* h);
+osThreadId uart_cobs_service_create(char *name, osPriority priority,
+	uint32_t stack_size, uart_cobs_service_t* h);
+osThreadId uart_cobs_service_create_static(char *name, osPriority priority,
+	uart_cobs_service_t* h);
 
 /* task routines */
 void uart_cobs_service_rx_task(void const * argument);
 void uart_cobs_service_tx_task(void const * argument);
+void uart_cobs_service_task(void const * argument);
 
 #ifdef __cplusplus
 }
@@ -84,6 +84,14 @@ typedef struct __packed
 	/* UART transfer complete semaphores */
 	SemaphoreHandle_t		rx_complete;
 	SemaphoreHandle_t		tx_complete;
+	/* Called from ISR instead of giving tx_complete, NULL if not used */
+	void					(*tx_callback)(void* arg,
+								BaseType_t* pxHigherPriorityTaskWoken);
+	void					*tx_callback_arg;
+	/* Called from ISR instead of giving rx_complete, NULL if not used */
+	void					(*rx_callback)(void* arg,
+								BaseType_t* pxHigherPriorityTaskWoken);
+	void					*rx_callback_arg;
 
 } uart_freertos_t;
 
@@ -114,6 +122,31 @@ uart_freertos_status uart_freertos_tx_dma (uart_freertos_t* uart, const void* da
 uart_freertos_status_t uart_freertos_rx_dma (uart_freertos_t* uart, const void* data, size_t data_size,
 		TickType_t mutex_timeout, TickType_t transfer_timeout);
 
+/* Start transmit using DMA without waiting, may be called from tx_callback.
+ * Caller must own TX of UART, completion is reported to tx_callback */
+uart_freertos_status uart_freertos_tx_dma_start (uart_freertos_t* uart, const void* data, size_t data_size);
+
+void uart_freertos_set_tx_callback(uart_freertos_t* uart,
+		void (*callback)(void* arg, BaseType_t* pxHigherPriorityTaskWoken), void* arg);
+
+/* Start receive using DMA with IDLE interrupt without waiting, stop
+ * returns bytes received. Caller must own RX of UART, DMA complete and
+ * IDLE are reported to rx_callback */
+uart_freertos_status uart_freertos_rx_dma_start (uart_freertos_t* uart, const void* data, size_t data_size);
+size_t uart_freertos_rx_dma_stop (uart_freertos_t* uart, size_t data_size);
+
+void uart_freertos_set_rx_callback(uart_freertos_t* uart,
+		void (*callback)(void* arg, BaseType_t* pxHigherPriorityTaskWoken), void* arg);
+
+/* UART_FREERTOS_OK if USART can run at "baud": up to its clock / 16
+ * and within 2 % of the rate */
+uart_freertos_status uart_freertos_check_baud (uart_freertos_t* uart, uint32_t baud);
+
+/* Change baud rate once the last byte is out, reception goes on at the
+ * new rate. UART_FREERTOS_ERR and no change if USART can not run at
+ * "baud". Caller must own TX of UART */
+uart_freertos_status uart_freertos_set_baud (uart_freertos_t* uart, uint32_t baud);
+
 uart_freertos_status_t uart_freertos_rx_dma_idle (uart_freertos_t* uart, const void* data, size_t data_size,
 		TickType_t mutex_timeout,TickType_t expectation_timeout, TickType_t idle_timeout);
 
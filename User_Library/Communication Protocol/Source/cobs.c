@@ -4,8 +4,61 @@
  * with or without modification.
  */
 
+#include <string.h>
+
 #include "cobs.h"
 
+/* Magic constants of the zero byte search in a 32 bit word */
+#define COBS_ONES	0x01010101UL
+#define COBS_HIGHS	0x80808080UL
+
+/* Returns the number of leading nonzero bytes of "data", looking at no
+ * more than "limit" bytes. Four bytes are tested per iteration, the
+ * lowest set bit of the mask marks the first zero byte of a little
+ * endian word (RBIT + CLZ on Cortex-M3). Borrows may set bits above
+ * the first zero byte only, so the result is exact.
+ */
+static inline size_t cobs_find_zero(const uint8_t *data, size_t limit)
+{
+    size_t index = 0;
+#if defined(__GNUC__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+    uint32_t word;
+    uint32_t mask;
+
+    while(index + sizeof(word) <= limit)
+    {
+        memcpy(&word, &data[index], sizeof(word));
+        mask = (word - COBS_ONES) & ~word & COBS_HIGHS;
+        if(mask)
+            return index + ((size_t) __builtin_ctzl(mask) >> 3);
+        index += sizeof(word);
+    }
+#endif
+    while(index < limit && data[index] != 0)
+        index++;
+    return index;
+}
+
+/* Copies "length" bytes forward a word at a time. Safe for overlapping
+ * buffers as long as "output" is not above "input".
+ */
+static inline void cobs_copy(uint8_t *output, const uint8_t *input,
+	size_t length)
+{
+    uint32_t word;
+
+    while(length >= sizeof(word))
+    {
+        memcpy(&word, input, sizeof(word));
+        memcpy(output, &word, sizeof(word));
+        input += sizeof(word);
+        output += sizeof(word);
+        length -= sizeof(word);
+    }
+    while(length--)
+        *output++ = *input++;
+}
+
 /* Stuffs "length" bytes of data at the location pointed to by
  * "input", writing the output to the location pointed to by
  * "output". Returns the number of bytes written to "output".
@@ -19,31 +72,380 @@ size_t cobs_encode(const uint8_t * restrict input, size_t length,
     size_t read_index = 0;
     size_t write_index = 1;
     size_t code_index = 0;
-    uint8_t code = 1;
+    size_t run;
 
-    while(read_index < length)
+    while(1)
     {
-        if(input[read_index] == 0)
+        /* Empty block, a lone zero */
+        if(read_index < length && input[read_index] == 0)
         {
-            output[code_index] = code;
-            code = 1;
+            output[code_index] = 1;
             code_index = write_index++;
             read_index++;
+            continue;
+        }
+
+        /* Copy nonzero run of up to 254 bytes */
+        run = length - read_index;
+        if(run > 0xFE)
+            run = 0xFE;
+        run = cobs_find_zero(&input[read_index], run);
+        cobs_copy(&output[write_index], &input[read_index], run);
+        read_index += run;
+        write_index += run;
+
+        if(run == 0xFE)
+        {
+            output[code_index] = 0xFF;
+            code_index = write_index++;
+            continue;
+        }
+
+        output[code_index] = (uint8_t) (run + 1);
+        if(read_index >= length)
+            break;
+
+        /* Skip zero byte */
+        read_index++;
+        code_index = write_index++;
+    }
+
+    return write_index;
+}
+
+/* Splits block "code" of "codec" into the number of data bytes and
+ * the number of zeros following them.
+ *
+ * COBS and COBS/R: 0x01-0xFE - code-1 bytes and a zero,
+ *                  0xFF      - 254 bytes.
+ * COBS/ZPE:        0x01-0xDF - code-1 bytes and a zero,
+ *                  0xE0      - 223 bytes,
+ *                  0xE1-0xFF - code-0xE1 bytes and a pair of zeros.
+ */
+static inline void cobs_block(cobs_codec_t codec, uint8_t code,
+	uint8_t *data, uint8_t *zeros)
+{
+    if(codec == COBS_CODEC_ZPE && code >= COBS_ZPE_RUN)
+    {
+        if(code == COBS_ZPE_RUN)
+        {
+            *data = COBS_ZPE_RUN - 1;
+            *zeros = 0;
         }
         else
         {
-            output[write_index++] = input[read_index++];
-            code++;
-            if(code == 0xFF)
+            *data = code - COBS_ZPE_PAIR;
+            *zeros = 2;
+        }
+    }
+    else
+    {
+        *data = code - 1;
+        *zeros = (code == 0xFF) ? 0 : 1;
+    }
+}
+
+/* Returns the largest number of bytes "codec" stuffs "length" bytes
+ * into, without the delimiter.
+ */
+size_t cobs_max_encoded_size(cobs_codec_t codec, size_t length)
+{
+    if(codec == COBS_CODEC_ZPE)
+        return COBS_ZPE_MAX_ENCODED_SIZE(length);
+    return COBS_MAX_ENCODED_SIZE(length);
+}
+
+/* Prepares "encoder" to stuff a frame with "codec", writing the
+ * output to the location pointed to by "output".
+ */
+void cobs_encoder_init(cobs_encoder_t *encoder, cobs_codec_t codec,
+	uint8_t *output)
+{
+    encoder->output = output;
+    encoder->size = 0;
+    encoder->start = 0;
+    encoder->length = 1;
+    encoder->code_index = 0;
+    encoder->codec = codec;
+    encoder->block = 0;
+    encoder->pair = 0;
+    encoder->hook = NULL;
+    encoder->hook_arg = NULL;
+}
+
+/* Prepares "encoder" to stuff a frame with "codec" into the ring of
+ * "size" bytes pointed to by "ring", starting at offset "start". The
+ * frame wraps to the beginning of the ring, the caller makes sure
+ * that enough bytes are free.
+ */
+void cobs_encoder_init_ring(cobs_encoder_t *encoder, cobs_codec_t codec,
+	uint8_t *ring, size_t size, size_t start)
+{
+    cobs_encoder_init(encoder, codec, ring);
+    encoder->size = size;
+    encoder->start = start;
+}
+
+/* Makes "encoder" pass every input byte to "hook" right after it is
+ * stuffed. NULL stops it.
+ */
+void cobs_encoder_hook(cobs_encoder_t *encoder, cobs_hook_t hook,
+	void *arg)
+{
+    encoder->hook = hook;
+    encoder->hook_arg = arg;
+}
+
+/* Returns the location of byte "index" of the frame of "encoder" */
+static inline uint8_t *cobs_encoder_at(const cobs_encoder_t *encoder,
+	size_t index)
+{
+    index += encoder->start;
+    if(encoder->size != 0 && index >= encoder->size)
+        index -= encoder->size;
+    return &encoder->output[index];
+}
+
+/* Copies "length" bytes to byte "index" of the frame of "encoder",
+ * splitting the copy where the ring wraps.
+ */
+static inline void cobs_encoder_copy(const cobs_encoder_t *encoder,
+	size_t index, const uint8_t *input, size_t length)
+{
+    uint8_t *output = cobs_encoder_at(encoder, index);
+    size_t room;
+
+    if(encoder->size != 0)
+    {
+        room = (size_t) (&encoder->output[encoder->size] - output);
+        if(length > room)
+        {
+            cobs_copy(output, input, room);
+            output = encoder->output;
+            input += room;
+            length -= room;
+        }
+    }
+    cobs_copy(output, input, length);
+}
+
+/* Stuffs "length" bytes of data at the location pointed to by
+ * "input" as the continuation of the frame started by
+ * cobs_encoder_init(). A block may span several calls.
+ */
+void cobs_encoder_feed(cobs_encoder_t *encoder, const uint8_t *input,
+	size_t length)
+{
+    size_t read_index = 0;
+    size_t write_index = encoder->length;
+    size_t code_index = encoder->code_index;
+    size_t block = encoder->block;
+    size_t block_max = 0xFE;
+    uint8_t block_full = 0xFF;
+    size_t from;
+    size_t run;
+
+    if(encoder->codec == COBS_CODEC_ZPE)
+    {
+        block_max = COBS_ZPE_RUN - 1;
+        block_full = COBS_ZPE_RUN;
+    }
+
+    while(read_index < length)
+    {
+        from = read_index;
+
+        /* Short block ended with a zero, a second zero makes a pair */
+        if(encoder->pair)
+        {
+            encoder->pair = 0;
+            if(input[read_index] == 0)
+            {
+                *cobs_encoder_at(encoder, code_index) =
+                    (uint8_t) (COBS_ZPE_PAIR + block);
+                read_index++;
+            }
+            else
+                *cobs_encoder_at(encoder, code_index) = (uint8_t) (block + 1);
+            code_index = write_index++;
+            block = 0;
+        }
+        else
+        {
+            /* Copy nonzero run, block may continue from previous call */
+            run = length - read_index;
+            if(run > block_max - block)
+                run = block_max - block;
+            run = cobs_find_zero(&input[read_index], run);
+            cobs_encoder_copy(encoder, write_index, &input[read_index], run);
+            read_index += run;
+            write_index += run;
+            block += run;
+
+            if(block == block_max)
             {
-                output[code_index] = code;
-                code = 1;
+                *cobs_encoder_at(encoder, code_index) = block_full;
                 code_index = write_index++;
+                block = 0;
+            }
+            else if(read_index < length)
+            {
+                /* Skip zero byte */
+                read_index++;
+                if(encoder->codec == COBS_CODEC_ZPE
+                    && block <= 0xFF - COBS_ZPE_PAIR)
+                    encoder->pair = 1;
+                else
+                {
+                    *cobs_encoder_at(encoder, code_index) =
+                        (uint8_t) (block + 1);
+                    code_index = write_index++;
+                    block = 0;
+                }
             }
         }
+
+        /* Run and zero just read go to the hook in the same pass */
+        if(encoder->hook != NULL && read_index != from)
+            encoder->hook(encoder->hook_arg, &input[from], read_index - from);
     }
 
-    output[code_index] = code;
+    encoder->length = write_index;
+    encoder->code_index = code_index;
+    encoder->block = (uint8_t) block;
+}
+
+/* Completes the frame of "encoder". Returns the number of bytes
+ * written to the output, the delimiter is not appended.
+ */
+size_t cobs_encoder_finish(cobs_encoder_t *encoder)
+{
+    uint8_t code = (uint8_t) (encoder->block + 1);
+
+    /* Trailing zero pairs with the implicit zero at the end */
+    if(encoder->pair)
+    {
+        encoder->pair = 0;
+        code = (uint8_t) (COBS_ZPE_PAIR + encoder->block);
+    }
+    /* COBS/R moves last byte to the code if it is greater */
+    else if(encoder->codec == COBS_CODEC_COBSR && encoder->block != 0
+        && *cobs_encoder_at(encoder, encoder->length - 1) > code)
+    {
+        code = *cobs_encoder_at(encoder, --encoder->length);
+    }
+
+    *cobs_encoder_at(encoder, encoder->code_index) = code;
+    return encoder->length;
+}
+
+/* Stuffs "count" segments pointed to by "segments" as one frame,
+ * writing the output to the location pointed to by "output". The
+ * output is the same as of cobs_encode() over the concatenated
+ * segments. Returns the number of bytes written to "output".
+ */
+size_t cobs_encode_v(const cobs_segment_t *segments, size_t count,
+	uint8_t * restrict output)
+{
+    cobs_encoder_t encoder;
+
+    cobs_encoder_init(&encoder, COBS_CODEC_COBS, output);
+    for(; count > 0; count--, segments++)
+        cobs_encoder_feed(&encoder, segments->data, segments->size);
+
+    return cobs_encoder_finish(&encoder);
+}
+
+/* Stuffs "length" bytes of data at the location pointed to by
+ * "input" with "codec", writing the output to the location pointed
+ * to by "output". Returns the number of bytes written to "output".
+ */
+size_t cobs_codec_encode(cobs_codec_t codec, const uint8_t * restrict input,
+	size_t length, uint8_t * restrict output)
+{
+    cobs_encoder_t encoder;
+
+    if(codec == COBS_CODEC_COBS)
+        return cobs_encode(input, length, output);
+
+    cobs_encoder_init(&encoder, codec, output);
+    cobs_encoder_feed(&encoder, input, length);
+
+    return cobs_encoder_finish(&encoder);
+}
+
+/* Unstuffs "length" bytes of data at the location pointed to by
+ * "input" with "codec", writing the output to the location pointed
+ * to by "output". Returns the number of bytes written to "output".
+ * For COBS and COBS/R "output" may be equal to "input", but must not
+ * be above it. Every block written is passed to "hook" unless it is
+ * NULL.
+ */
+static size_t cobs_unstuff(cobs_codec_t codec, const uint8_t *input,
+	size_t length, uint8_t *output, cobs_hook_t hook, void *arg)
+{
+    size_t read_index = 0;
+    size_t write_index = 0;
+    size_t block_index;
+    uint8_t code;
+    uint8_t data;
+    uint8_t zeros;
+
+    while(read_index < length)
+    {
+        block_index = write_index;
+        code = input[read_index++];
+
+        /* Zero is the frame delimiter, never a code */
+        if(code == 0)
+        {
+            return 0;
+        }
+
+        /* Empty block, a lone zero */
+        if(code == 1)
+        {
+            if(read_index != length)
+            {
+                output[write_index++] = '\0';
+                if(hook != NULL)
+                    hook(arg, &output[block_index], 1);
+            }
+            continue;
+        }
+
+        cobs_block(codec, code, &data, &zeros);
+
+        if(read_index + data > length)
+        {
+            if(codec != COBS_CODEC_COBSR)
+                return 0;
+            /* COBS/R final block, code is the last byte */
+            data = (uint8_t) (length - read_index);
+            zeros = 0;
+            cobs_copy(&output[write_index], &input[read_index], data);
+            read_index = length;
+            write_index += data;
+            output[write_index++] = code;
+        }
+        else
+        {
+            cobs_copy(&output[write_index], &input[read_index], data);
+            read_index += data;
+            write_index += data;
+        }
+
+        /* Implicit zero at the end of frame is dropped */
+        if(read_index == length && zeros != 0)
+            zeros--;
+        while(zeros--)
+        {
+            output[write_index++] = '\0';
+        }
+
+        if(hook != NULL && write_index != block_index)
+            hook(arg, &output[block_index], write_index - block_index);
+    }
 
     return write_index;
 }
@@ -52,7 +454,7 @@ size_t cobs_encode(const uint8_t * restrict input, size_t length,
  * "input", writing the output * to the location pointed to by
  * "output". Returns the number of bytes written to "output" if
  * "input" was successfully unstuffed, and 0 if there was an
- * error unstuffing "input".
+ * error unstuffing "input". A 0x00 code byte is an error.
  *
  * Remove the "restrict" qualifiers if compiling with a
  * pre-C99 C dialect.
@@ -60,31 +462,180 @@ size_t cobs_encode(const uint8_t * restrict input, size_t length,
 size_t cobs_decode(const uint8_t * restrict input, size_t length,
 	uint8_t * restrict output)
 {
-    size_t read_index = 0;
-    size_t write_index = 0;
-    uint8_t code;
-    uint8_t i;
+    return cobs_unstuff(COBS_CODEC_COBS, input, length, output, NULL, NULL);
+}
 
-    while(read_index < length)
+/* Unstuffs "length" bytes of data at the location pointed to by
+ * "input" with "codec", writing the output to the location pointed
+ * to by "output". Returns the number of bytes written to "output" if
+ * "input" was successfully unstuffed, and 0 if there was an error.
+ *
+ * COBS and COBS/R frames may be unstuffed in place, "output" equal
+ * to "input". COBS/ZPE frames may grow, a pair of zeros takes one
+ * byte, so "output" must not overlap "input".
+ */
+size_t cobs_codec_decode(cobs_codec_t codec, const uint8_t *input,
+	size_t length, uint8_t *output)
+{
+    return cobs_unstuff(codec, input, length, output, NULL, NULL);
+}
+
+/* Unstuffs like cobs_codec_decode(), passing the output to "hook"
+ * block by block as it is written, e.g. to feed a CRC in the same
+ * pass. A malformed frame may be passed in part before 0 is returned.
+ */
+size_t cobs_codec_decode_hook(cobs_codec_t codec, const uint8_t *input,
+	size_t length, uint8_t *output, cobs_hook_t hook, void *arg)
+{
+    return cobs_unstuff(codec, input, length, output, hook, arg);
+}
+
+/* Prepares "decoder" to unstuff the next frame of "codec" into
+ * "size" bytes at the location pointed to by "output". Call it
+ * again after every completed frame to hand over a new output
+ * buffer.
+ */
+void cobs_decoder_init(cobs_decoder_t *decoder, cobs_codec_t codec,
+	uint8_t *output, size_t size)
+{
+    decoder->output = output;
+    decoder->size = size;
+    decoder->length = 0;
+    decoder->codec = codec;
+    decoder->code = 0;
+    decoder->count = 0;
+    decoder->zeros = 0;
+    decoder->error = 0;
+}
+
+/* Returns nonzero while "decoder" holds the beginning of a frame or
+ * drops a frame, i.e. until the next delimiter is fed.
+ */
+int cobs_decoder_pending(const cobs_decoder_t *decoder)
+{
+    return decoder->code != 0 || decoder->error;
+}
+
+/* Appends "byte" to the decoder output, drops the frame if it does
+ * not fit.
+ */
+static inline int cobs_decoder_put(cobs_decoder_t *decoder, uint8_t byte)
+{
+    if(decoder->length >= decoder->size)
     {
-        code = input[read_index];
+        decoder->error = 1;
+        decoder->length = 0;
+        return 0;
+    }
+    decoder->output[decoder->length++] = byte;
+    return 1;
+}
+
+/* Completes the frame at delimiter */
+static cobs_decoder_status_t cobs_decoder_end(cobs_decoder_t *decoder)
+{
+    cobs_decoder_status_t status = COBS_DECODER_FRAME;
 
-        if(read_index + code > length && code != 1)
+    if(decoder->error)
+        status = COBS_DECODER_ERROR;
+    else if(decoder->count != 0)
+    {
+        /* COBS/R final block, code is the last byte */
+        if(decoder->codec != COBS_CODEC_COBSR
+            || !cobs_decoder_put(decoder, decoder->code))
+            status = COBS_DECODER_ERROR;
+    }
+    else
+    {
+        /* Implicit zero at the end of frame is dropped */
+        while(decoder->zeros > 1)
         {
-            return 0;
+            decoder->zeros--;
+            if(!cobs_decoder_put(decoder, '\0'))
+            {
+                status = COBS_DECODER_ERROR;
+                break;
+            }
         }
+    }
 
-        read_index++;
+    if(status == COBS_DECODER_ERROR)
+        decoder->length = 0;
+    decoder->code = 0;
+    decoder->count = 0;
+    decoder->zeros = 0;
+    decoder->error = 0;
+    return status;
+}
 
-        for(i = 1; i < code; i++)
+/* Unstuffs up to "length" bytes of a byte stream pointed to by
+ * "input" into the decoder output buffer. The stream may be split
+ * at any byte, frames are separated by 0x00 delimiters. Stops right
+ * after the first delimiter and stores the number of bytes taken
+ * from "input" to "consumed". Returns COBS_DECODER_FRAME when a
+ * frame of "decoder->length" bytes is complete, COBS_DECODER_ERROR
+ * when a malformed or oversized frame was dropped and
+ * COBS_DECODER_MORE when all of "input" was consumed.
+ *
+ * For COBS and COBS/R the output is never ahead of the input, so
+ * "input" may point into the output buffer at or after
+ * "output + length". While a frame is dropped "length" stays 0, so
+ * receiving the next bytes at "output + length" is always safe.
+ */
+cobs_decoder_status_t cobs_decoder_feed(cobs_decoder_t *decoder,
+	const uint8_t *input, size_t length, size_t *consumed)
+{
+    cobs_decoder_status_t status = COBS_DECODER_MORE;
+    size_t read_index = 0;
+    size_t run;
+    uint8_t byte;
+
+    while(read_index < length)
+    {
+        byte = input[read_index++];
+
+        if(byte == 0)
         {
-            output[write_index++] = input[read_index++];
+            /* Empty frames are only delimiter padding */
+            if(decoder->code == 0 && !decoder->error)
+                continue;
+            status = cobs_decoder_end(decoder);
+            break;
         }
-        if(code != 0xFF && read_index != length)
+
+        if(decoder->error)
+            continue;
+
+        if(decoder->count != 0)
         {
-            output[write_index++] = '\0';
+            if(!cobs_decoder_put(decoder, byte))
+                continue;
+            decoder->count--;
+            /* Copy the rest of the block available in "input" */
+            run = length - read_index;
+            if(run > decoder->count)
+                run = decoder->count;
+            if(run > decoder->size - decoder->length)
+                run = decoder->size - decoder->length;
+            run = cobs_find_zero(&input[read_index], run);
+            cobs_copy(&decoder->output[decoder->length], &input[read_index], run);
+            read_index += run;
+            decoder->length += run;
+            decoder->count -= (uint8_t) run;
+            continue;
         }
+
+        /* Code byte, zeros of the previous block come first */
+        if(decoder->code == 0)
+            decoder->length = 0;
+        while(decoder->zeros != 0 && cobs_decoder_put(decoder, '\0'))
+            decoder->zeros--;
+        if(decoder->error)
+            continue;
+        decoder->code = byte;
+        cobs_block(decoder->codec, byte, &decoder->count, &decoder->zeros);
     }
 
-    return write_index;
+    *consumed = read_index;
+    return status;
 }
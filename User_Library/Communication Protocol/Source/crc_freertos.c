@@ -0,0 +1,188 @@
+#include <string.h>
+
+/* FreeRTOS */
+#include "stm32f1xx_hal.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+#include "crc_freertos.h"
+
+/* CRC unit is shared by all users */
+static SemaphoreHandle_t crc_mutex = NULL;
+#if (configSUPPORT_STATIC_ALLOCATION == 1)
+static StaticSemaphore_t crc_mutex_buffer;
+#endif
+
+/* Enable CRC unit clock and create its mutex, in static memory where
+ * FreeRTOS allows it. The static mutex is created with the scheduler
+ * suspended. The heap one is created outside of the critical section,
+ * one of two racing callers deletes its own again. */
+crc_freertos_status crc_freertos_init(void)
+{
+	crc_freertos_status rtn = CRC_FREERTOS_EXIST;
+#if (configSUPPORT_STATIC_ALLOCATION == 1)
+	if(crc_mutex != NULL)
+		return CRC_FREERTOS_EXIST;
+
+	vTaskSuspendAll();
+	if(crc_mutex == NULL)
+	{
+		__HAL_RCC_CRC_CLK_ENABLE();
+		crc_mutex = xSemaphoreCreateMutexStatic(&crc_mutex_buffer);
+		rtn = CRC_FREERTOS_OK;
+	}
+	(void) xTaskResumeAll();
+	return rtn;
+#else
+	SemaphoreHandle_t mutex = NULL;
+
+	if(crc_mutex != NULL)
+		return CRC_FREERTOS_EXIST;
+	mutex = xSemaphoreCreateMutex();
+	if(mutex == NULL)
+		return CRC_FREERTOS_ERR;
+
+	taskENTER_CRITICAL();
+	if(crc_mutex == NULL)
+	{
+		__HAL_RCC_CRC_CLK_ENABLE();
+		crc_mutex = mutex;
+		mutex = NULL;
+		rtn = CRC_FREERTOS_OK;
+	}
+	taskEXIT_CRITICAL();
+
+	if(mutex != NULL)
+		vSemaphoreDelete(mutex);
+	return rtn;
+#endif
+}
+
+/* Feed one byte to CRC calculated in software, bit by bit */
+static uint32_t crc_freertos_byte(uint32_t crc, uint8_t byte)
+{
+	uint8_t bit;
+
+	crc ^= (uint32_t) byte << 24;
+	for(bit = 0; bit < 8; bit++)
+	{
+		if(crc & 0x80000000UL)
+			crc = (crc << 1) ^ CRC_FREERTOS_POLY;
+		else
+			crc <<= 1;
+	}
+	return crc;
+}
+
+/* Take CRC unit and reset it, data are accumulated until the end */
+crc_freertos_status crc_freertos_begin(crc_freertos_t* crc,
+	TickType_t mutex_timeout)
+{
+	if(xSemaphoreTake(crc_mutex, mutex_timeout) == pdFALSE)
+		return CRC_FREERTOS_BUSY;
+
+	CRC->CR = CRC_CR_RESET;
+	crc->tail = 0;
+	crc->tail_size = 0;
+	crc->software = 0;
+	return CRC_FREERTOS_OK;
+}
+
+/* Start CRC calculated in software, CRC unit stays free */
+void crc_freertos_begin_software(crc_freertos_t* crc)
+{
+	crc->tail = 0xFFFFFFFFUL;
+	crc->tail_size = 0;
+	crc->software = 1;
+}
+
+/* Feed data to CRC unit word by word */
+void crc_freertos_update(crc_freertos_t* crc, const void* data,
+	size_t data_size)
+{
+	const uint8_t* byte = (const uint8_t*) data;
+	uint32_t word;
+
+	if(crc->software)
+	{
+		while(data_size-- != 0)
+			crc->tail = crc_freertos_byte(crc->tail, *byte++);
+		return;
+	}
+
+	/* complete word started by previous update */
+	while(crc->tail_size != 0 && data_size != 0)
+	{
+		crc->tail = (crc->tail << 8) | *byte++;
+		data_size--;
+		if(++crc->tail_size == sizeof(word))
+		{
+			CRC->DR = crc->tail;
+			crc->tail = 0;
+			crc->tail_size = 0;
+		}
+	}
+
+	/* unit takes MSB first, so swap bytes of little endian words */
+	while(data_size >= sizeof(word))
+	{
+		memcpy(&word, byte, sizeof(word));
+		CRC->DR = __REV(word);
+		byte += sizeof(word);
+		data_size -= sizeof(word);
+	}
+
+	while(data_size-- != 0)
+	{
+		crc->tail = (crc->tail << 8) | *byte++;
+		crc->tail_size++;
+	}
+}
+
+/* Process remaining bytes, give back CRC unit and return CRC */
+uint32_t crc_freertos_end(crc_freertos_t* crc)
+{
+	uint32_t rtn = 0;
+
+	if(crc->software)
+		return crc->tail;
+
+	/* unit takes whole words only, up to three bytes are left */
+	rtn = CRC->DR;
+	while(crc->tail_size != 0)
+	{
+		crc->tail_size--;
+		rtn = crc_freertos_byte(rtn,
+			(uint8_t) (crc->tail >> (8 * crc->tail_size)));
+	}
+
+	/* Give back CRC mutex */
+	xSemaphoreGive(crc_mutex);
+
+	return rtn;
+}
+
+/* Give back CRC unit, calculation goes on in software. CRC has no
+ * final XOR, so the value so far is where software picks up. */
+void crc_freertos_release(crc_freertos_t* crc)
+{
+	if(crc->software)
+		return;
+	crc->tail = crc_freertos_end(crc);
+	crc->tail_size = 0;
+	crc->software = 1;
+}
+
+/* Calculate CRC of buffer */
+crc_freertos_status crc_freertos_calc(const void* data, size_t data_size,
+	uint32_t* result, TickType_t mutex_timeout)
+{
+	crc_freertos_t crc;
+
+	if(crc_freertos_begin(&crc, mutex_timeout) != CRC_FREERTOS_OK)
+		return CRC_FREERTOS_BUSY;
+	crc_freertos_update(&crc, data, data_size);
+	*result = crc_freertos_end(&crc);
+	return CRC_FREERTOS_OK;
+}
@@ -0,0 +1,366 @@
+#include "cobs.h"
+#include "slip.h"
+#include "length_prefix.h"
+#include "framer.h"
+
+/*----------------------------------------------------------------------
+  COBS family, codec is kept in encoder and decoder state
+----------------------------------------------------------------------*/
+
+static size_t framer_cobs_max_encoded_size(size_t length)
+{
+	return cobs_max_encoded_size(COBS_CODEC_COBS, length) + 1;
+}
+
+static size_t framer_cobs_zpe_max_encoded_size(size_t length)
+{
+	return cobs_max_encoded_size(COBS_CODEC_ZPE, length) + 1;
+}
+
+static void framer_cobs_encoder_init(framer_encoder_t *encoder,
+	uint8_t *output, size_t size, size_t start, size_t length)
+{
+	(void) length;
+	cobs_encoder_init_ring(&encoder->cobs, COBS_CODEC_COBS, output, size, start);
+}
+
+static void framer_cobsr_encoder_init(framer_encoder_t *encoder,
+	uint8_t *output, size_t size, size_t start, size_t length)
+{
+	(void) length;
+	cobs_encoder_init_ring(&encoder->cobs, COBS_CODEC_COBSR, output, size, start);
+}
+
+static void framer_cobs_zpe_encoder_init(framer_encoder_t *encoder,
+	uint8_t *output, size_t size, size_t start, size_t length)
+{
+	(void) length;
+	cobs_encoder_init_ring(&encoder->cobs, COBS_CODEC_ZPE, output, size, start);
+}
+
+static void framer_cobs_encoder_feed(framer_encoder_t *encoder,
+	const uint8_t *input, size_t length)
+{
+	cobs_encoder_feed(&encoder->cobs, input, length);
+}
+
+/* Encoder passes each run to the hook right after copying it */
+static void framer_cobs_encoder_hook(framer_encoder_t *encoder,
+	framer_hook_t hook, void *arg)
+{
+	cobs_encoder_hook(&encoder->cobs, hook, arg);
+}
+
+/* Delimiter wraps like the frame */
+static size_t framer_cobs_encoder_finish(framer_encoder_t *encoder)
+{
+	cobs_encoder_t *cobs = &encoder->cobs;
+	size_t length = cobs_encoder_finish(cobs);
+	size_t index = cobs->start + length;
+	if(cobs->size != 0 && index >= cobs->size)
+		index -= cobs->size;
+	cobs->output[index] = 0x00;
+	return length + 1;
+}
+
+static void framer_cobs_decoder_init(framer_decoder_t *decoder,
+	uint8_t *output, size_t size)
+{
+	cobs_decoder_init(&decoder->cobs, COBS_CODEC_COBS, output, size);
+}
+
+static void framer_cobsr_decoder_init(framer_decoder_t *decoder,
+	uint8_t *output, size_t size)
+{
+	cobs_decoder_init(&decoder->cobs, COBS_CODEC_COBSR, output, size);
+}
+
+static void framer_cobs_zpe_decoder_init(framer_decoder_t *decoder,
+	uint8_t *output, size_t size)
+{
+	cobs_decoder_init(&decoder->cobs, COBS_CODEC_ZPE, output, size);
+}
+
+static int framer_cobs_decoder_pending(const framer_decoder_t *decoder)
+{
+	return cobs_decoder_pending(&decoder->cobs);
+}
+
+/* cobs_decoder_status_t and framer_status share their values */
+static framer_status framer_cobs_decoder_feed(framer_decoder_t *decoder,
+	const uint8_t *input, size_t length, size_t *consumed)
+{
+	return (framer_status) cobs_decoder_feed(&decoder->cobs, input, length,
+		consumed);
+}
+
+/* Nothing between two delimiters is no frame, empty payload is a
+ * single 0x01 code, any other zero length result is a malformed frame */
+static size_t framer_cobs_decode_codec(cobs_codec_t codec,
+	const uint8_t *input, size_t length, uint8_t *output,
+	framer_hook_t hook, void *arg)
+{
+	uint8_t empty = (length == 1 && input[0] == 0x01);
+	size_t rtn = 0;
+	if(length == 0)
+		return FRAMER_EMPTY;
+	rtn = cobs_codec_decode_hook(codec, input, length, output, hook, arg);
+	if(rtn == 0 && !empty)
+		return FRAMER_INVALID;
+	return rtn;
+}
+
+static size_t framer_cobs_decode(const uint8_t *input, size_t length,
+	uint8_t *output, framer_hook_t hook, void *arg)
+{
+	return framer_cobs_decode_codec(COBS_CODEC_COBS, input, length, output, hook,
+		arg);
+}
+
+static size_t framer_cobsr_decode(const uint8_t *input, size_t length,
+	uint8_t *output, framer_hook_t hook, void *arg)
+{
+	return framer_cobs_decode_codec(COBS_CODEC_COBSR, input, length, output, hook,
+		arg);
+}
+
+const framer_t framer_cobs =
+{
+	.delimiter			= 0x00,
+	.max_encoded_size	= framer_cobs_max_encoded_size,
+	.encoder_init		= framer_cobs_encoder_init,
+	.encoder_feed		= framer_cobs_encoder_feed,
+	.encoder_hook		= framer_cobs_encoder_hook,
+	.encoder_finish		= framer_cobs_encoder_finish,
+	.decoder_init		= framer_cobs_decoder_init,
+	.decoder_pending	= framer_cobs_decoder_pending,
+	.decoder_feed		= framer_cobs_decoder_feed,
+	.decode				= framer_cobs_decode
+};
+
+const framer_t framer_cobsr =
+{
+	.delimiter			= 0x00,
+	.max_encoded_size	= framer_cobs_max_encoded_size,
+	.encoder_init		= framer_cobsr_encoder_init,
+	.encoder_feed		= framer_cobs_encoder_feed,
+	.encoder_hook		= framer_cobs_encoder_hook,
+	.encoder_finish		= framer_cobs_encoder_finish,
+	.decoder_init		= framer_cobsr_decoder_init,
+	.decoder_pending	= framer_cobs_decoder_pending,
+	.decoder_feed		= framer_cobs_decoder_feed,
+	.decode				= framer_cobsr_decode
+};
+
+/* COBS/ZPE frames may decode longer than they are encoded */
+const framer_t framer_cobs_zpe =
+{
+	.delimiter			= 0x00,
+	.max_encoded_size	= framer_cobs_zpe_max_encoded_size,
+	.encoder_init		= framer_cobs_zpe_encoder_init,
+	.encoder_feed		= framer_cobs_encoder_feed,
+	.encoder_hook		= framer_cobs_encoder_hook,
+	.encoder_finish		= framer_cobs_encoder_finish,
+	.decoder_init		= framer_cobs_zpe_decoder_init,
+	.decoder_pending	= framer_cobs_decoder_pending,
+	.decoder_feed		= framer_cobs_decoder_feed,
+	.decode				= NULL
+};
+
+/*----------------------------------------------------------------------
+  SLIP
+----------------------------------------------------------------------*/
+
+static void framer_slip_encoder_init(framer_encoder_t *encoder,
+	uint8_t *output, size_t size, size_t start, size_t length)
+{
+	(void) length;
+	slip_encoder_init(&encoder->slip, output, size, start);
+}
+
+static void framer_slip_encoder_feed(framer_encoder_t *encoder,
+	const uint8_t *input, size_t length)
+{
+	slip_encoder_feed(&encoder->slip, input, length);
+}
+
+static size_t framer_slip_encoder_finish(framer_encoder_t *encoder)
+{
+	return slip_encoder_finish(&encoder->slip);
+}
+
+static void framer_slip_decoder_init(framer_decoder_t *decoder,
+	uint8_t *output, size_t size)
+{
+	slip_decoder_init(&decoder->slip, output, size);
+}
+
+static int framer_slip_decoder_pending(const framer_decoder_t *decoder)
+{
+	return slip_decoder_pending(&decoder->slip);
+}
+
+/* slip_decoder_status and framer_status share their values */
+static framer_status framer_slip_decoder_feed(framer_decoder_t *decoder,
+	const uint8_t *input, size_t length, size_t *consumed)
+{
+	return (framer_status) slip_decoder_feed(&decoder->slip, input, length,
+		consumed);
+}
+
+/* RFC 1055 peers send END before every packet, nothing between two
+ * ENDs is no frame. Nonempty frame never unescapes to nothing. Hook
+ * gets the frame once it is unescaped. */
+static size_t framer_slip_decode(const uint8_t *input, size_t length,
+	uint8_t *output, framer_hook_t hook, void *arg)
+{
+	size_t rtn = 0;
+	if(length == 0)
+		return FRAMER_EMPTY;
+	rtn = slip_decode(input, length, output);
+	if(rtn == 0)
+		return FRAMER_INVALID;
+	if(hook != NULL)
+		hook(arg, output, rtn);
+	return rtn;
+}
+
+const framer_t framer_slip =
+{
+	.delimiter			= SLIP_END,
+	.max_encoded_size	= slip_max_encoded_size,
+	.encoder_init		= framer_slip_encoder_init,
+	.encoder_feed		= framer_slip_encoder_feed,
+	.encoder_hook		= NULL,
+	.encoder_finish		= framer_slip_encoder_finish,
+	.decoder_init		= framer_slip_decoder_init,
+	.decoder_pending	= framer_slip_decoder_pending,
+	.decoder_feed		= framer_slip_decoder_feed,
+	.decode				= framer_slip_decode
+};
+
+/*----------------------------------------------------------------------
+  Length prefix
+----------------------------------------------------------------------*/
+
+static void framer_length_prefix_encoder_init(framer_encoder_t *encoder,
+	uint8_t *output, size_t size, size_t start, size_t length)
+{
+	length_prefix_encoder_init(&encoder->length_prefix, output, size, start,
+		length);
+}
+
+static void framer_length_prefix_encoder_feed(framer_encoder_t *encoder,
+	const uint8_t *input, size_t length)
+{
+	length_prefix_encoder_feed(&encoder->length_prefix, input, length);
+}
+
+static size_t framer_length_prefix_encoder_finish(framer_encoder_t *encoder)
+{
+	return length_prefix_encoder_finish(&encoder->length_prefix);
+}
+
+static void framer_length_prefix_decoder_init(framer_decoder_t *decoder,
+	uint8_t *output, size_t size)
+{
+	length_prefix_decoder_init(&decoder->length_prefix, output, size);
+}
+
+static int framer_length_prefix_decoder_pending(
+	const framer_decoder_t *decoder)
+{
+	return length_prefix_decoder_pending(&decoder->length_prefix);
+}
+
+/* length_prefix_decoder_status and framer_status share their values */
+static framer_status framer_length_prefix_decoder_feed(
+	framer_decoder_t *decoder, const uint8_t *input, size_t length,
+	size_t *consumed)
+{
+	return (framer_status) length_prefix_decoder_feed(
+		&decoder->length_prefix, input, length, consumed);
+}
+
+/* Frames are not delimited, so they are not decoded in place */
+const framer_t framer_length_prefix =
+{
+	.delimiter			= FRAMER_NO_DELIMITER,
+	.max_encoded_size	= length_prefix_max_encoded_size,
+	.encoder_init		= framer_length_prefix_encoder_init,
+	.encoder_feed		= framer_length_prefix_encoder_feed,
+	.encoder_hook		= NULL,
+	.encoder_finish		= framer_length_prefix_encoder_finish,
+	.decoder_init		= framer_length_prefix_decoder_init,
+	.decoder_pending	= framer_length_prefix_decoder_pending,
+	.decoder_feed		= framer_length_prefix_decoder_feed,
+	.decode				= NULL
+};
+
+/*----------------------------------------------------------------------
+  Dispatch
+----------------------------------------------------------------------*/
+
+/* Prepares "encoder" to encode a frame of "length" bytes with "framer"
+ * into the ring of "size" bytes at "output", starting at offset
+ * "start". Size 0 means a linear buffer.
+ */
+void framer_encoder_init(framer_encoder_t *encoder, const framer_t *framer,
+	uint8_t *output, size_t size, size_t start, size_t length)
+{
+	encoder->framer = framer;
+	encoder->hook = NULL;
+	encoder->hook_arg = NULL;
+	framer->encoder_init(encoder, output, size, start, length);
+}
+
+/* Passes the input of following feeds to "hook" while it is encoded,
+ * NULL stops it.
+ */
+void framer_encoder_hook(framer_encoder_t *encoder, framer_hook_t hook,
+	void *arg)
+{
+	encoder->hook = hook;
+	encoder->hook_arg = arg;
+	if(encoder->framer->encoder_hook != NULL)
+		encoder->framer->encoder_hook(encoder, hook, arg);
+}
+
+void framer_encoder_feed(framer_encoder_t *encoder, const uint8_t *input,
+	size_t length)
+{
+	/* Framer without a hook of its own, input goes to hook first */
+	if(encoder->hook != NULL && encoder->framer->encoder_hook == NULL)
+		encoder->hook(encoder->hook_arg, input, length);
+	encoder->framer->encoder_feed(encoder, input, length);
+}
+
+/* Returns the number of bytes written, delimiter included */
+size_t framer_encoder_finish(framer_encoder_t *encoder)
+{
+	return encoder->framer->encoder_finish(encoder);
+}
+
+/* Prepares "decoder" to decode a frame with "framer" into the buffer
+ * of "size" bytes at "output".
+ */
+void framer_decoder_init(framer_decoder_t *decoder, const framer_t *framer,
+	uint8_t *output, size_t size)
+{
+	decoder->framer = framer;
+	framer->decoder_init(decoder, output, size);
+}
+
+int framer_decoder_pending(const framer_decoder_t *decoder)
+{
+	return decoder->framer->decoder_pending(decoder);
+}
+
+/* Stops after the first complete frame, "consumed" is set to the
+ * number of bytes taken from "input".
+ */
+framer_status framer_decoder_feed(framer_decoder_t *decoder,
+	const uint8_t *input, size_t length, size_t *consumed)
+{
+	return decoder->framer->decoder_feed(decoder, input, length, consumed);
+}
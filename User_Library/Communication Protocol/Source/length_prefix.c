@@ -0,0 +1,212 @@
+#include <string.h>
+
+#include "length_prefix.h"
+
+/* Decoder states */
+#define LENGTH_PREFIX_STATE_HEADER	0
+#define LENGTH_PREFIX_STATE_PAYLOAD	1
+#define LENGTH_PREFIX_STATE_CRC		2
+
+/* CRC-16/CCITT-FALSE of every nibble value */
+static const uint16_t length_prefix_crc_table[16] =
+{
+	0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+	0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+/* Continues CRC-16 "crc" over "length" bytes at "data", a nibble at a
+ * time. Start with 0xFFFF.
+ */
+uint16_t length_prefix_crc(uint16_t crc, const uint8_t *data, size_t length)
+{
+	while(length--)
+	{
+		crc = (uint16_t) (crc << 4)
+			^ length_prefix_crc_table[(crc >> 12) ^ (*data >> 4)];
+		crc = (uint16_t) (crc << 4)
+			^ length_prefix_crc_table[(crc >> 12) ^ (*data & 0x0F)];
+		data++;
+	}
+	return crc;
+}
+
+/* Header check byte of payload length "length" */
+static inline uint8_t length_prefix_check(const uint8_t *length)
+{
+	return (uint8_t) length_prefix_crc(0xFFFF, length, 2);
+}
+
+/* Returns the number of bytes a frame of "length" payload bytes takes */
+size_t length_prefix_max_encoded_size(size_t length)
+{
+	return LENGTH_PREFIX_MAX_ENCODED_SIZE(length);
+}
+
+/* Copies "length" bytes to the frame of "encoder", splitting the copy
+ * where the ring wraps.
+ */
+static void length_prefix_encoder_put(length_prefix_encoder_t *encoder,
+	const uint8_t *input, size_t length)
+{
+	size_t room;
+
+	encoder->length += length;
+	if(encoder->size != 0)
+	{
+		room = encoder->size - encoder->index;
+		if(length >= room)
+		{
+			memcpy(&encoder->output[encoder->index], input, room);
+			encoder->index = 0;
+			input += room;
+			length -= room;
+		}
+	}
+	memcpy(&encoder->output[encoder->index], input, length);
+	encoder->index += length;
+}
+
+/* Prepares "encoder" to frame "length" bytes into the ring of "size"
+ * bytes pointed to by "output", starting at offset "start". Size 0
+ * means a linear buffer. The header is written right away.
+ */
+void length_prefix_encoder_init(length_prefix_encoder_t *encoder,
+	uint8_t *output, size_t size, size_t start, size_t length)
+{
+	uint8_t header[LENGTH_PREFIX_HEADER_SIZE];
+
+	encoder->output = output;
+	encoder->size = size;
+	encoder->index = start;
+	encoder->length = 0;
+	encoder->crc = 0xFFFF;
+
+	header[0] = (uint8_t) length;
+	header[1] = (uint8_t) (length >> 8);
+	header[2] = length_prefix_check(header);
+	length_prefix_encoder_put(encoder, header, sizeof(header));
+}
+
+/* Copies "length" payload bytes at the location pointed to by "input"
+ * to the frame of "encoder".
+ */
+void length_prefix_encoder_feed(length_prefix_encoder_t *encoder,
+	const uint8_t *input, size_t length)
+{
+	encoder->crc = length_prefix_crc(encoder->crc, input, length);
+	length_prefix_encoder_put(encoder, input, length);
+}
+
+/* Appends CRC to the frame of "encoder". Returns the number of bytes
+ * written to the output.
+ */
+size_t length_prefix_encoder_finish(length_prefix_encoder_t *encoder)
+{
+	uint8_t crc[LENGTH_PREFIX_CRC_SIZE];
+
+	crc[0] = (uint8_t) encoder->crc;
+	crc[1] = (uint8_t) (encoder->crc >> 8);
+	length_prefix_encoder_put(encoder, crc, sizeof(crc));
+	return encoder->length;
+}
+
+/* Prepares "decoder" to receive a frame into the buffer of "size"
+ * bytes pointed to by "output".
+ */
+void length_prefix_decoder_init(length_prefix_decoder_t *decoder,
+	uint8_t *output, size_t size)
+{
+	decoder->output = output;
+	decoder->size = size;
+	decoder->length = 0;
+	decoder->expected = 0;
+	decoder->crc = 0xFFFF;
+	decoder->count = 0;
+	decoder->state = LENGTH_PREFIX_STATE_HEADER;
+}
+
+/* Returns nonzero if "decoder" is in the middle of a frame */
+int length_prefix_decoder_pending(const length_prefix_decoder_t *decoder)
+{
+	return decoder->state != LENGTH_PREFIX_STATE_HEADER
+		|| decoder->count != 0;
+}
+
+/* Takes a header byte. A header with a bad check or a length beyond
+ * the buffer is slid by one byte, so the decoder hunts for the next
+ * frame after noise.
+ */
+static void length_prefix_decoder_header(length_prefix_decoder_t *decoder,
+	uint8_t byte)
+{
+	decoder->field[decoder->count++] = byte;
+	if(decoder->count < LENGTH_PREFIX_HEADER_SIZE)
+		return;
+
+	decoder->expected = decoder->field[0]
+		| ((size_t) decoder->field[1] << 8);
+	if(decoder->field[2] != length_prefix_check(decoder->field)
+		|| decoder->expected > decoder->size)
+	{
+		decoder->field[0] = decoder->field[1];
+		decoder->field[1] = decoder->field[2];
+		decoder->count--;
+		return;
+	}
+
+	decoder->count = 0;
+	decoder->state = (decoder->expected != 0) ?
+		LENGTH_PREFIX_STATE_PAYLOAD : LENGTH_PREFIX_STATE_CRC;
+}
+
+/* Takes "length" bytes at the location pointed to by "input",
+ * stopping after the first complete frame. "consumed" is set to the
+ * number of bytes taken from "input".
+ */
+length_prefix_decoder_status length_prefix_decoder_feed(
+	length_prefix_decoder_t *decoder, const uint8_t *input, size_t length,
+	size_t *consumed)
+{
+	size_t read_index = 0;
+	size_t run;
+	uint16_t crc;
+
+	while(read_index < length)
+	{
+		switch(decoder->state)
+		{
+		case LENGTH_PREFIX_STATE_HEADER:
+			length_prefix_decoder_header(decoder, input[read_index++]);
+			break;
+
+		case LENGTH_PREFIX_STATE_PAYLOAD:
+			run = decoder->expected - decoder->length;
+			if(run > length - read_index)
+				run = length - read_index;
+			memcpy(&decoder->output[decoder->length], &input[read_index], run);
+			decoder->crc = length_prefix_crc(decoder->crc,
+				&input[read_index], run);
+			decoder->length += run;
+			read_index += run;
+			if(decoder->length == decoder->expected)
+				decoder->state = LENGTH_PREFIX_STATE_CRC;
+			break;
+
+		default:
+			decoder->field[decoder->count++] = input[read_index++];
+			if(decoder->count < LENGTH_PREFIX_CRC_SIZE)
+				break;
+			*consumed = read_index;
+			crc = decoder->field[0] | (uint16_t) (decoder->field[1] << 8);
+			if(crc != decoder->crc)
+			{
+				decoder->length = 0;
+				return LENGTH_PREFIX_DECODER_ERROR;
+			}
+			return LENGTH_PREFIX_DECODER_FRAME;
+		}
+	}
+
+	*consumed = read_index;
+	return LENGTH_PREFIX_DECODER_MORE;
+}
@@ -0,0 +1,188 @@
+#include <string.h>
+
+#include "slip.h"
+
+/* Returns the largest number of bytes "length" bytes are escaped into,
+ * END included.
+ */
+size_t slip_max_encoded_size(size_t length)
+{
+	return SLIP_MAX_ENCODED_SIZE(length);
+}
+
+/* Prepares "encoder" to escape a frame into the ring of "size" bytes
+ * pointed to by "output", starting at offset "start". Size 0 means a
+ * linear buffer.
+ */
+void slip_encoder_init(slip_encoder_t *encoder, uint8_t *output,
+	size_t size, size_t start)
+{
+	encoder->output = output;
+	encoder->size = size;
+	encoder->index = start;
+	encoder->length = 0;
+}
+
+/* Writes one byte of the frame of "encoder" */
+static inline void slip_encoder_put(slip_encoder_t *encoder, uint8_t byte)
+{
+	encoder->output[encoder->index++] = byte;
+	if(encoder->index == encoder->size)
+		encoder->index = 0;
+	encoder->length++;
+}
+
+/* Escapes "length" bytes of data at the location pointed to by
+ * "input" as the continuation of the frame of "encoder".
+ */
+void slip_encoder_feed(slip_encoder_t *encoder, const uint8_t *input,
+	size_t length)
+{
+	while(length--)
+	{
+		switch(*input)
+		{
+		case SLIP_END:
+			slip_encoder_put(encoder, SLIP_ESC);
+			slip_encoder_put(encoder, SLIP_ESC_END);
+			break;
+		case SLIP_ESC:
+			slip_encoder_put(encoder, SLIP_ESC);
+			slip_encoder_put(encoder, SLIP_ESC_ESC);
+			break;
+		default:
+			slip_encoder_put(encoder, *input);
+			break;
+		}
+		input++;
+	}
+}
+
+/* Appends END to the frame of "encoder". Returns the number of bytes
+ * written to the output.
+ */
+size_t slip_encoder_finish(slip_encoder_t *encoder)
+{
+	slip_encoder_put(encoder, SLIP_END);
+	return encoder->length;
+}
+
+/* Unescapes "length" bytes of data at the location pointed to by
+ * "input", END not included, writing the output to the location
+ * pointed to by "output". "output" may be equal to "input". Returns
+ * the number of bytes written to "output", 0 if the frame is
+ * malformed.
+ */
+size_t slip_decode(const uint8_t *input, size_t length, uint8_t *output)
+{
+	size_t read_index = 0;
+	size_t write_index = 0;
+	const uint8_t *escape;
+	size_t run;
+
+	while(read_index < length)
+	{
+		/* Copy run up to next ESC */
+		escape = memchr(&input[read_index], SLIP_ESC, length - read_index);
+		run = (escape ? (size_t) (escape - input) : length) - read_index;
+		if(&output[write_index] != &input[read_index])
+			memmove(&output[write_index], &input[read_index], run);
+		read_index += run;
+		write_index += run;
+		if(escape == NULL)
+			break;
+
+		if(++read_index >= length)
+			return 0;
+		switch(input[read_index++])
+		{
+		case SLIP_ESC_END:
+			output[write_index++] = SLIP_END;
+			break;
+		case SLIP_ESC_ESC:
+			output[write_index++] = SLIP_ESC;
+			break;
+		default:
+			return 0;
+		}
+	}
+
+	return write_index;
+}
+
+/* Prepares "decoder" to unescape a frame into the buffer of "size"
+ * bytes pointed to by "output".
+ */
+void slip_decoder_init(slip_decoder_t *decoder, uint8_t *output,
+	size_t size)
+{
+	decoder->output = output;
+	decoder->size = size;
+	decoder->length = 0;
+	decoder->escape = 0;
+	decoder->error = 0;
+}
+
+/* Returns nonzero if "decoder" is in the middle of a frame */
+int slip_decoder_pending(const slip_decoder_t *decoder)
+{
+	return decoder->length != 0 || decoder->escape || decoder->error;
+}
+
+/* Unescapes "length" bytes at the location pointed to by "input",
+ * stopping after the first END that completes a frame. Empty frames
+ * are skipped. "consumed" is set to the number of bytes taken from
+ * "input".
+ */
+slip_decoder_status slip_decoder_feed(slip_decoder_t *decoder,
+	const uint8_t *input, size_t length, size_t *consumed)
+{
+	size_t read_index = 0;
+	uint8_t byte;
+
+	while(read_index < length)
+	{
+		byte = input[read_index++];
+		if(byte == SLIP_END)
+		{
+			if(!slip_decoder_pending(decoder))
+				continue;
+			*consumed = read_index;
+			if(decoder->error || decoder->escape)
+			{
+				decoder->length = 0;
+				return SLIP_DECODER_ERROR;
+			}
+			return SLIP_DECODER_FRAME;
+		}
+		if(decoder->error)
+			continue;
+
+		if(decoder->escape)
+		{
+			decoder->escape = 0;
+			if(byte == SLIP_ESC_END)
+				byte = SLIP_END;
+			else if(byte == SLIP_ESC_ESC)
+				byte = SLIP_ESC;
+			else
+			{
+				decoder->error = 1;
+				continue;
+			}
+		}
+		else if(byte == SLIP_ESC)
+		{
+			decoder->escape = 1;
+			continue;
+		}
+
+		if(decoder->length == decoder->size)
+			decoder->error = 1;
+		else
+			decoder->output[decoder->length++] = byte;
+	}
+
+	*consumed = read_index;
+	return SLIP_DECODER_MORE;
+}
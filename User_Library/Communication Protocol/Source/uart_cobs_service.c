@@ -1,138 +1,2128 @@
+#include <string.h>
+
 #include "main.h"
 #include "stm32f1xx_hal.h"
 #include "FreeRTOS.h"
 #include "task.h"
 #include "queue.h"
+#include "semphr.h"
 #include "cmsis_os.h"
 
-#include "uart_freertos.h"
-#include "cobs.h"
-#include "uart_cobs_service.h"
+#include "uart_freertos.h"
+#include "cobs.h"
+#include "framer.h"
+#include "crc_freertos.h"
+#include "uart_cobs_service.h"
+
+/* Requests of RX task to TX task */
+#define UART_COBS_TX_ACK		0x01	// send ACK
+#define UART_COBS_TX_NACK		0x02	// send NACK
+#define UART_COBS_TX_RESEND		0x04	// peer sent NACK
+#define UART_COBS_TX_BAUD		0x08	// peer proposed baud rate
+#define UART_COBS_TX_BAUD_ACK	0x10	// peer answered proposal or check
+#define UART_COBS_TX_BAUD_CHECK	0x20	// peer checks new rate
+#define UART_COBS_TX_BAUD_START	0x40	// uart_cobs_set_baud() called
+#define UART_COBS_TX_RESET_ACK	0x80	// peer sent reset
+
+/* Baud rate negotiation states */
+#define UART_COBS_BAUD_IDLE		0
+#define UART_COBS_BAUD_PROPOSED	1	// proposal sent, waiting for answer
+#define UART_COBS_BAUD_CHECK	2	// switched, waiting for check
+#define UART_COBS_BAUD_CONFIRM	3	// check answered, waiting for confirm
+
+/* Check frames sent by proposer within baud timeout */
+#define UART_COBS_BAUD_CHECKS	4
+
+/* Frames carry type on link with flow control, reliable delivery or
+ * baud rate negotiation */
+static inline uint8_t uart_cobs_typed(uart_cobs_service_t* h)
+{
+	return h->flow_control || h->reliable || h->baud_max != 0;
+}
+
+/* Bytes added to payload: type, sequence number, channel and CRC */
+static inline size_t uart_cobs_overhead(uart_cobs_service_t* h)
+{
+	size_t size = 0;
+	if(uart_cobs_typed(h))
+		size += UART_COBS_TYPE_SIZE;
+	if(h->reliable)
+		size += UART_COBS_SEQ_SIZE;
+	if(h->channels != NULL)
+		size += UART_COBS_CHANNEL_SIZE;
+	if(h->crc != UART_COBS_CRC_NONE)
+		size += UART_COBS_CRC_SIZE;
+	return size;
+}
+
+/* Largest payload with channel and CRC */
+static inline size_t uart_cobs_payload_size(uart_cobs_service_t* h)
+{
+	return h->max_frame_size + uart_cobs_overhead(h);
+}
+
+/* Framing engine of service */
+static inline const framer_t* uart_cobs_framer(uart_cobs_service_t* h)
+{
+	if(h->framer == NULL)
+		return &framer_cobs;
+	return h->framer;
+}
+
+/* Arenas of static service, NULL - heap */
+static inline uart_cobs_arena_t* uart_cobs_rx_arena(uart_cobs_service_t* h)
+{
+	return (h->storage != NULL) ? &h->storage->rx : NULL;
+}
+
+static inline uart_cobs_arena_t* uart_cobs_tx_arena(uart_cobs_service_t* h)
+{
+	return (h->storage != NULL) ? &h->storage->tx : NULL;
+}
+
+/* Memory of "size" bytes from arena or heap */
+static void* uart_cobs_alloc(uart_cobs_arena_t* arena, size_t size)
+{
+	void* mem = NULL;
+	if(arena == NULL)
+	{
+		mem = pvPortMalloc(size);
+		if(!mem) Error_Handler();
+		return mem;
+	}
+	size = UART_COBS_STATIC_ALIGN(size);
+	if(arena->size - arena->used < size) Error_Handler();
+	mem = &arena->buffer[arena->used];
+	arena->used += size;
+	return mem;
+}
+
+static QueueHandle_t uart_cobs_queue_create(uart_cobs_arena_t* arena,
+	UBaseType_t length, UBaseType_t item_size)
+{
+	QueueHandle_t queue = NULL;
+	if(arena == NULL)
+		queue = xQueueCreate(length, item_size);
+	else
+		queue = xQueueCreateStatic(length, item_size,
+			uart_cobs_alloc(arena, length*item_size),
+			uart_cobs_alloc(arena, sizeof(StaticQueue_t)));
+	if(!queue) Error_Handler();
+	return queue;
+}
+
+static SemaphoreHandle_t uart_cobs_binary_create(uart_cobs_arena_t* arena)
+{
+	SemaphoreHandle_t sem = NULL;
+	if(arena == NULL)
+		sem = xSemaphoreCreateBinary();
+	else
+		sem = xSemaphoreCreateBinaryStatic(
+			uart_cobs_alloc(arena, sizeof(StaticSemaphore_t)));
+	if(!sem) Error_Handler();
+	return sem;
+}
+
+static SemaphoreHandle_t uart_cobs_counting_create(uart_cobs_arena_t* arena,
+	UBaseType_t max)
+{
+	SemaphoreHandle_t sem = NULL;
+	if(arena == NULL)
+		sem = xSemaphoreCreateCounting(max, 0);
+	else
+		sem = xSemaphoreCreateCountingStatic(max, 0,
+			uart_cobs_alloc(arena, sizeof(StaticSemaphore_t)));
+	if(!sem) Error_Handler();
+	return sem;
+}
+
+/* Take CRC unit for a frame. Single task mode does not wait for a unit
+ * held by another task, the frame is checked in software then */
+static void uart_cobs_crc_begin(uart_cobs_service_t* h, crc_freertos_t* crc)
+{
+	if(crc_freertos_begin(crc, (h->task != NULL) ? 0 : portMAX_DELAY)
+		!= CRC_FREERTOS_OK)
+		crc_freertos_begin_software(crc);
+}
+
+/* CRC unit fed while a frame is decoded in one pass, split frame
+ * included. The last bytes decoded may be the received CRC, so they
+ * are held back until more follow. */
+struct uart_cobs_rx_crc
+{
+	crc_freertos_t		crc;
+	const uint8_t		*fed;		// frame is fed up to here
+	uint8_t				active;		// frame is being fed
+};
+
+static void uart_cobs_rx_crc_hook(void* arg, const uint8_t* data,
+	size_t length)
+{
+	struct uart_cobs_rx_crc* rx_crc = (struct uart_cobs_rx_crc *) arg;
+	size_t ready = 0;
+	if(&data[length] <= rx_crc->fed + UART_COBS_CRC_SIZE)
+		return;
+	ready = (size_t) (&data[length] - rx_crc->fed) - UART_COBS_CRC_SIZE;
+	crc_freertos_update(&rx_crc->crc, rx_crc->fed, ready);
+	rx_crc->fed += ready;
+}
+
+/* CRC unit fed while a frame is encoded */
+static void uart_cobs_tx_crc_hook(void* arg, const uint8_t* data,
+	size_t length)
+{
+	crc_freertos_update((crc_freertos_t *) arg, data, length);
+}
+
+/* Check and strip CRC of received frame. "fed" was fed while the
+ * frame was decoded and is given back here. */
+static BaseType_t uart_cobs_crc_check(uart_cobs_service_t* h,
+	uart_cobs_frame_t* frame, struct uart_cobs_rx_crc* fed)
+{
+	uint32_t crc = 0;
+	uint32_t received = 0;
+	if(h->crc == UART_COBS_CRC_NONE)
+		return pdTRUE;
+	crc = crc_freertos_end(&fed->crc);
+	if(frame->size < UART_COBS_CRC_SIZE)
+		return pdFALSE;
+	frame->size -= UART_COBS_CRC_SIZE;
+	memcpy(&received, (uint8_t *) frame->data + frame->size,
+		UART_COBS_CRC_SIZE);
+	return crc == received;
+}
+
+/* TX DMA ring, task appends frames at head, DMA drains from tail */
+struct uart_cobs_tx_ring
+{
+	uart_freertos_t		*huart;
+	uint8_t				*buffer;
+	size_t				size;
+	volatile size_t		head;
+	volatile size_t		tail;
+	/* bytes of DMA transfer in progress, 0 - DMA is idle */
+	volatile size_t		sending;
+	/* given each time DMA frees space */
+	SemaphoreHandle_t	space;
+	/* notified as well in single task mode, NULL - not used */
+	TaskHandle_t		task;
+	/* failed starts, also of TX complete ISR, added to stats and
+	 * retried by the task */
+	volatile uint32_t	errors;
+};
+
+/* Static size of ring state must cover it */
+_Static_assert(sizeof(struct uart_cobs_tx_ring) <= UART_COBS_TX_RING_STATE_SIZE,
+	"UART_COBS_TX_RING_STATE_SIZE too small");
+
+/* Free bytes of ring, one byte is kept to tell full from empty */
+static inline size_t uart_cobs_tx_ring_free(struct uart_cobs_tx_ring* ring)
+{
+	size_t head = ring->head;
+	size_t tail = ring->tail;
+	if(head >= tail)
+		return ring->size - 1 - (head - tail);
+	return tail - head - 1;
+}
+
+/* Start DMA on bytes from tail up to head or end of ring, called with
+ * interrupts masked or from TX complete ISR */
+static void uart_cobs_tx_ring_kick(struct uart_cobs_tx_ring* ring)
+{
+	size_t head = ring->head;
+	size_t tail = ring->tail;
+	if(ring->sending != 0 || head == tail)
+		return;
+	ring->sending = (head > tail ? head : ring->size) - tail;
+	if(uart_freertos_tx_dma_start(ring->huart, &ring->buffer[tail],
+		ring->sending) != UART_FREERTOS_OK)
+	{
+		ring->sending = 0;
+		ring->errors++;
+	}
+}
+
+/* Restart DMA after failed start, bytes wait in ring meanwhile.
+ * Failed starts counted so far go to stats of the task */
+static void uart_cobs_tx_ring_retry(uart_cobs_service_t* h,
+	struct uart_cobs_tx_ring* ring)
+{
+	uint32_t errors = 0;
+	taskENTER_CRITICAL();
+	uart_cobs_tx_ring_kick(ring);
+	errors = ring->errors;
+	ring->errors = 0;
+	taskEXIT_CRITICAL();
+	h->stats.tx_errors += errors;
+}
+
+/* Ring holds bytes but no transfer runs, DMA failed to start */
+static inline BaseType_t uart_cobs_tx_ring_stalled(
+	struct uart_cobs_tx_ring* ring)
+{
+	return (ring->sending == 0 && ring->head != ring->tail) ? pdTRUE : pdFALSE;
+}
+
+/* TX complete ISR, next transfer is chained without waking the task */
+static void uart_cobs_tx_ring_complete(void* arg,
+	BaseType_t* pxHigherPriorityTaskWoken)
+{
+	struct uart_cobs_tx_ring* ring = (struct uart_cobs_tx_ring *) arg;
+	size_t tail = ring->tail + ring->sending;
+	if(tail == ring->size)
+		tail = 0;
+	ring->tail = tail;
+	ring->sending = 0;
+	uart_cobs_tx_ring_kick(ring);
+	xSemaphoreGiveFromISR(ring->space, pxHigherPriorityTaskWoken);
+	if(ring->task != NULL)
+		vTaskNotifyGiveFromISR(ring->task, pxHigherPriorityTaskWoken);
+}
+
+/* Take TX of UART for good, transfers are started without its mutex */
+static void uart_cobs_tx_take(uart_cobs_service_t* h)
+{
+	xSemaphoreTake(h->huart->tx_mutex, portMAX_DELAY);
+}
+
+/* Allocate ring and take TX of UART for good */
+static struct uart_cobs_tx_ring* uart_cobs_tx_ring_create(
+	uart_cobs_service_t* h, size_t frame_size)
+{
+	uart_cobs_arena_t* arena = uart_cobs_tx_arena(h);
+	struct uart_cobs_tx_ring* ring = uart_cobs_alloc(arena, sizeof(*ring));
+	ring->huart = h->huart;
+	/* largest frame must fit next to the spare byte */
+	ring->size = h->tx_ring_size;
+	if(ring->size < frame_size + 1)
+		ring->size = frame_size + 1;
+	ring->buffer = uart_cobs_alloc(arena, ring->size);
+	ring->head = 0;
+	ring->tail = 0;
+	ring->sending = 0;
+	ring->space = uart_cobs_binary_create(arena);
+	ring->task = h->task;
+	ring->errors = 0;
+	uart_cobs_tx_take(h);
+	uart_freertos_set_tx_callback(h->huart, uart_cobs_tx_ring_complete, ring);
+	return ring;
+}
+
+/* Copy of frame to queue, size of segments is summed up. Returns
+ * pdFALSE if lane does not exist or frame is too large */
+static BaseType_t uart_cobs_tx_item(uart_cobs_service_t* h,
+	const uart_cobs_tx_frame_t* frame, uart_cobs_tx_frame_t* item)
+{
+	const cobs_segment_t* segments = (const cobs_segment_t *) frame->data;
+	if(frame->lane >= UART_COBS_TX_LANES
+		|| h->input_queue[frame->lane] == NULL)
+		return pdFALSE;
+	*item = *frame;
+	if(item->count)
+	{
+		item->size = 0;
+		for(size_t i = 0; i < item->count; i++)
+			item->size += segments[i].size;
+	}
+	if(item->size > h->max_frame_size)
+		return pdFALSE;
+	item->type = UART_COBS_TYPE_DATA;
+	return pdTRUE;
+}
+
+/* Queue frame for transmission in its lane */
+size_t uart_cobs_send_frame(uart_cobs_service_t* h,
+	const uart_cobs_tx_frame_t* frame, TickType_t timeout)
+{
+	uart_cobs_tx_frame_t item;
+	if(uart_cobs_tx_item(h, frame, &item) == pdFALSE)
+		return 0;
+	item.queued = xTaskGetTickCount();
+	if(xQueueSend(h->input_queue[item.lane], &item, timeout) == pdFALSE)
+		return 0;
+	xSemaphoreGive(h->tx_pending);
+	if(h->task != NULL)
+		xTaskNotifyGive(h->task);
+	return item.size;
+}
+
+/* Queue frame from ISR without waiting, 0 if lane is full. Caller
+ * yields with portYIELD_FROM_ISR() on pxHigherPriorityTaskWoken */
+size_t uart_cobs_send_frame_from_isr(uart_cobs_service_t* h,
+	const uart_cobs_tx_frame_t* frame, BaseType_t* pxHigherPriorityTaskWoken)
+{
+	uart_cobs_tx_frame_t item;
+	if(uart_cobs_tx_item(h, frame, &item) == pdFALSE)
+		return 0;
+	item.queued = xTaskGetTickCountFromISR();
+	if(xQueueSendFromISR(h->input_queue[item.lane], &item,
+		pxHigherPriorityTaskWoken) == pdFALSE)
+		return 0;
+	xSemaphoreGiveFromISR(h->tx_pending, pxHigherPriorityTaskWoken);
+	if(h->task != NULL)
+		vTaskNotifyGiveFromISR(h->task, pxHigherPriorityTaskWoken);
+	return item.size;
+}
+
+/* Send preformatted frame from ISR, data must stay valid until it is
+ * encoded */
+size_t uart_cobs_send_from_isr(uart_cobs_service_t* h, const void* data,
+	size_t size, BaseType_t* pxHigherPriorityTaskWoken)
+{
+	uart_cobs_tx_frame_t frame = {.data = data, .size = size, .count = 0,
+		.done = NULL, .arg = NULL, .channel = 0, .lane = 0};
+	return uart_cobs_send_frame_from_isr(h, &frame, pxHigherPriorityTaskWoken);
+}
+
+size_t uart_cobs_send(uart_cobs_service_t* h, void* data, size_t size,
+	TickType_t timeout)
+{
+	return uart_cobs_send_async(h, data, size, NULL, NULL, timeout);
+}
+
+/* Send segments as one frame, segments and their data must stay valid
+ * until the frame is encoded */
+size_t uart_cobs_sendv(uart_cobs_service_t* h, const cobs_segment_t* segments,
+	size_t count, TickType_t timeout)
+{
+	return uart_cobs_sendv_async(h, segments, count, NULL, NULL, timeout);
+}
+
+/* Send on logical channel, data must stay valid until it is encoded */
+size_t uart_cobs_send_channel(uart_cobs_service_t* h, uint8_t channel,
+	const void* data, size_t size, TickType_t timeout)
+{
+	uart_cobs_tx_frame_t frame = {.data = data, .size = size, .count = 0,
+		.done = NULL, .arg = NULL, .channel = channel, .lane = 0};
+	return uart_cobs_send_frame(h, &frame, timeout);
+}
+
+/* Send in priority lane, frame is sent ahead of frames queued in lower
+ * lanes. Data must stay valid until it is encoded */
+size_t uart_cobs_send_lane(uart_cobs_service_t* h, uint8_t lane,
+	const void* data, size_t size, TickType_t timeout)
+{
+	uart_cobs_tx_frame_t frame = {.data = data, .size = size, .count = 0,
+		.done = NULL, .arg = NULL, .channel = 0, .lane = lane};
+	return uart_cobs_send_frame(h, &frame, timeout);
+}
+
+/* Send without copy, "done" is called with "arg" once "data" may be
+ * reused, NULL if not needed */
+size_t uart_cobs_send_async(uart_cobs_service_t* h, const void* data,
+	size_t size, uart_cobs_tx_done_t done, void* arg, TickType_t timeout)
+{
+	uart_cobs_tx_frame_t frame = {.data = data, .size = size, .count = 0,
+		.done = done, .arg = arg, .channel = 0, .lane = 0};
+	return uart_cobs_send_frame(h, &frame, timeout);
+}
+
+/* Send segments as one frame, "done" is called with "arg" and
+ * "segments" once segments and their data may be reused */
+size_t uart_cobs_sendv_async(uart_cobs_service_t* h,
+	const cobs_segment_t* segments, size_t count, uart_cobs_tx_done_t done,
+	void* arg, TickType_t timeout)
+{
+	uart_cobs_tx_frame_t frame = {.data = segments, .size = 0, .count = count,
+		.done = done, .arg = arg, .channel = 0, .lane = 0};
+	return uart_cobs_send_frame(h, &frame, timeout);
+}
+
+/* Completion callback giving notification to task "arg", the
+ * producer waits with ulTaskNotifyTake() */
+void uart_cobs_tx_done_notify(void* arg, const void* data)
+{
+	(void) data;
+	xTaskNotifyGive((TaskHandle_t) arg);
+}
+
+/* Received frame belongs to caller until uart_cobs_release() */
+size_t uart_cobs_recv(uart_cobs_service_t* h, void** data, TickType_t timeout)
+{
+	if(h->output_queue == NULL)
+		return 0;
+	uart_cobs_frame_t frame = {.data = NULL, .size = 0};
+	xQueueReceive(h->output_queue, &frame, timeout);
+	*data = frame.data;
+	return frame.size;
+}
+
+/* Receive from logical channel, frame belongs to caller until
+ * uart_cobs_release() */
+size_t uart_cobs_recv_channel(uart_cobs_service_t* h, uint8_t channel,
+	void** data, TickType_t timeout)
+{
+	*data = NULL;
+	if(h->channels == NULL || channel >= h->channel_count
+		|| h->channels[channel].queue == NULL)
+		return 0;
+	uart_cobs_frame_t frame = {.data = NULL, .size = 0};
+	xQueueReceive(h->channels[channel].queue, &frame, timeout);
+	*data = frame.data;
+	return frame.size;
+}
+
+/* Take a slot of channel budget, pdFALSE if channel holds its queue
+ * depth of slots. Budgets add up to the pool, so a channel within
+ * budget always finds a free slot and a slow channel does not hold
+ * up the others */
+static BaseType_t uart_cobs_rx_claim(uart_cobs_service_t* h, uint8_t owner)
+{
+	BaseType_t claimed = pdTRUE;
+	if(h->channels == NULL)
+		return pdTRUE;
+	uart_cobs_channel_t* channel = &h->channels[owner - 1];
+	taskENTER_CRITICAL();
+	if(channel->held < channel->queue_depth)
+		channel->held++;
+	else
+		claimed = pdFALSE;
+	taskEXIT_CRITICAL();
+	return claimed;
+}
+
+/* Give slot back to channel budget */
+static void uart_cobs_rx_unclaim(uart_cobs_service_t* h, uint8_t owner)
+{
+	if(h->channels == NULL)
+		return;
+	taskENTER_CRITICAL();
+	h->channels[owner - 1].held--;
+	taskEXIT_CRITICAL();
+}
+
+/* Give slot of received frame back to receiver, "data" may point
+ * anywhere into the slot. Pointer outside the pool, slot held by the
+ * receiver and slot released twice are rejected with pdFALSE */
+BaseType_t uart_cobs_release(uart_cobs_service_t* h, void* data)
+{
+	if(h->free_queue == NULL || data == NULL)
+		return pdFALSE;
+	uint8_t* byte = (uint8_t *) data;
+	if(byte < h->rx_pool || byte >= &h->rx_pool[h->rx_slots*h->rx_slot_size])
+		return pdFALSE;
+	size_t index = (byte - h->rx_pool) / h->rx_slot_size;
+	taskENTER_CRITICAL();
+	uint8_t owner = h->rx_owned[index];
+	h->rx_owned[index] = 0;
+	taskEXIT_CRITICAL();
+	if(owner == 0)
+		return pdFALSE;
+	uart_cobs_rx_unclaim(h, owner);
+	void* slot = &h->rx_pool[index*h->rx_slot_size];
+	xQueueSend(h->free_queue, &slot, 0);
+	return pdTRUE;
+}
+
+/* Snapshot of link statistics, counters are copied at once */
+void uart_cobs_get_stats(uart_cobs_service_t* h, uart_cobs_stats_t* stats)
+{
+	taskENTER_CRITICAL();
+	memcpy(stats, &h->stats, sizeof(uart_cobs_stats_t));
+	taskEXIT_CRITICAL();
+}
+
+/* Dispatcher entry of message type, NULL if there is none. Entries
+ * are linked in a critical section and unlinked by RX task only, RX
+ * task walks the list without one. */
+static uart_cobs_dispatch_t* uart_cobs_dispatch_find(uart_cobs_service_t* h,
+	uint8_t type)
+{
+	uart_cobs_dispatch_t* entry = h->dispatch;
+	while(entry != NULL && (entry->type != type || entry->removed))
+		entry = entry->next;
+	return entry;
+}
+
+/* Link dispatcher entry, pdFALSE if type is taken. Lookup and link
+ * are one critical section, so one of two racing callers wins. */
+static BaseType_t uart_cobs_dispatch_link(uart_cobs_service_t* h,
+	uart_cobs_dispatch_t* entry)
+{
+	BaseType_t linked = pdFALSE;
+	taskENTER_CRITICAL();
+	if(uart_cobs_dispatch_find(h, entry->type) == NULL)
+	{
+		entry->next = h->dispatch;
+		h->dispatch = entry;
+		linked = pdTRUE;
+	}
+	taskEXIT_CRITICAL();
+	return linked;
+}
+
+/* Add dispatcher entry from heap, pdFALSE if type is taken. Service
+ * with static storage stays off the heap, its entries are registered
+ * with uart_cobs_register_static() only. */
+static BaseType_t uart_cobs_dispatch_add(uart_cobs_service_t* h,
+	uint8_t type, uart_cobs_handler_t handler, void* arg,
+	QueueHandle_t queue)
+{
+	uart_cobs_dispatch_t* entry = NULL;
+	if(h->storage != NULL)
+		return pdFALSE;
+	entry = pvPortMalloc(sizeof(uart_cobs_dispatch_t));
+	if(entry == NULL)
+		return pdFALSE;
+	entry->type = type;
+	entry->handler = handler;
+	entry->arg = arg;
+	entry->queue = queue;
+	entry->allocated = 1;
+	entry->removed = 0;
+	if(uart_cobs_dispatch_link(h, entry) == pdFALSE)
+	{
+		vPortFree(entry);
+		return pdFALSE;
+	}
+	return pdTRUE;
+}
+
+/* Unlink entries removed by uart_cobs_unregister(), RX task only and
+ * never while it holds an entry. Heap entries are freed, static ones
+ * are handed back by clearing removed. */
+static void uart_cobs_dispatch_sweep(uart_cobs_service_t* h)
+{
+	uart_cobs_dispatch_t* dropped = NULL;
+	uart_cobs_dispatch_t* prev = NULL;
+	uart_cobs_dispatch_t* entry = NULL;
+	uart_cobs_dispatch_t* next = NULL;
+	if(!h->dispatch_removed)
+		return;
+	taskENTER_CRITICAL();
+	h->dispatch_removed = 0;
+	entry = h->dispatch;
+	while(entry != NULL)
+	{
+		next = entry->next;
+		if(entry->removed && prev == NULL)
+			h->dispatch = next;
+		else if(entry->removed)
+			prev->next = next;
+		else
+			prev = entry;
+		if(entry->removed)
+		{
+			entry->next = dropped;
+			dropped = entry;
+		}
+		entry = next;
+	}
+	taskEXIT_CRITICAL();
+	while(dropped != NULL)
+	{
+		entry = dropped;
+		dropped = entry->next;
+		if(entry->allocated)
+			vPortFree(entry);
+		else
+			entry->removed = 0;
+	}
+}
+
+/* Call "handler" with "arg" in RX task for each message of "type" */
+BaseType_t uart_cobs_register(uart_cobs_service_t* h, uint8_t type,
+	uart_cobs_handler_t handler, void* arg)
+{
+	return uart_cobs_dispatch_add(h, type, handler, arg, NULL);
+}
+
+/* Pass messages of "type" to "queue" of uart_cobs_frame_t, consumer
+ * gives them back with uart_cobs_release() */
+BaseType_t uart_cobs_register_queue(uart_cobs_service_t* h, uint8_t type,
+	QueueHandle_t queue)
+{
+	return uart_cobs_dispatch_add(h, type, NULL, NULL, queue);
+}
+
+/* Link caller owned zeroed "entry" with type, handler or queue set,
+ * it stays in use until unregistered and its removed flag reads 0
+ * again, pdFALSE while RX task has yet to drop it */
+BaseType_t uart_cobs_register_static(uart_cobs_service_t* h,
+	uart_cobs_dispatch_t* entry)
+{
+	if(entry->removed)
+		return pdFALSE;
+	entry->allocated = 0;
+	return uart_cobs_dispatch_link(h, entry);
+}
+
+/* Remove dispatcher entry of "type", messages go to output or channel
+ * queue again. Safe from any task and from a handler: RX task may be
+ * running the entry, so it is only marked here and RX task unlinks
+ * and frees it before it decodes further data. */
+void uart_cobs_unregister(uart_cobs_service_t* h, uint8_t type)
+{
+	uart_cobs_dispatch_t* entry = NULL;
+	taskENTER_CRITICAL();
+	entry = uart_cobs_dispatch_find(h, type);
+	if(entry != NULL)
+	{
+		entry->removed = 1;
+		h->dispatch_removed = 1;
+	}
+	taskEXIT_CRITICAL();
+}
+
+/* Receive limit of this end: data frames received so far plus free
+ * slots */
+static uint16_t uart_cobs_rx_limit(uart_cobs_service_t* h)
+{
+	uint16_t free = 0;
+	if(h->free_queue != NULL)
+		free = (uint16_t) uxQueueMessagesWaiting(h->free_queue);
+	return h->rx_count + free;
+}
+
+/* Pass requests to TX task. TX task holding a frame back waits for an
+ * event, otherwise for pending frames. A spare pending count makes it
+ * look at requests and find no frame. */
+static void uart_cobs_tx_wake(uart_cobs_service_t* h, uint8_t control)
+{
+	taskENTER_CRITICAL();
+	h->tx_control |= control;
+	taskEXIT_CRITICAL();
+	if(h->tx_event != NULL)
+		xSemaphoreGive(h->tx_event);
+	if(control != 0 && h->tx_pending != NULL
+		&& uxSemaphoreGetCount(h->tx_pending) == 0)
+		xSemaphoreGive(h->tx_pending);
+}
+
+/* Negotiate "baud" with peer, returns once both ends run at it or fell
+ * back. pdFALSE if negotiation is off or busy, USART of either end can
+ * not run at "baud", the peer refused or the check at the new rate
+ * failed. Service must be running, handlers must not call it */
+BaseType_t uart_cobs_set_baud(uart_cobs_service_t* h, uint32_t baud)
+{
+	BaseType_t busy = pdFALSE;
+	if(h->baud_done == NULL || baud == 0 || baud > h->baud_max
+		|| uart_freertos_check_baud(h->huart, baud) != UART_FREERTOS_OK)
+		return pdFALSE;
+	taskENTER_CRITICAL();
+	busy = (h->baud_request != 0);
+	if(!busy)
+		h->baud_request = baud;
+	taskEXIT_CRITICAL();
+	if(busy)
+		return pdFALSE;
+	uart_cobs_tx_wake(h, UART_COBS_TX_BAUD_START);
+	if(h->task != NULL)
+		xTaskNotifyGive(h->task);
+	xSemaphoreTake(h->baud_done, portMAX_DELAY);
+	return (h->baud_result == baud) ? pdTRUE : pdFALSE;
+}
+
+/* Take header off received frame. Control frames are consumed, data
+ * frames count for credit and, in reliable delivery, pass in sequence
+ * only. Returns pdTRUE if frame is to be delivered. */
+static BaseType_t uart_cobs_rx_header(uart_cobs_service_t* h,
+	uart_cobs_frame_t* frame)
+{
+	uint8_t type = UART_COBS_TYPE_DATA;
+	uint8_t seq = 0;
+	uint16_t limit = 0;
+	uint16_t sent = 0;
+	uint32_t rate = 0;
+	if(uart_cobs_typed(h))
+	{
+		if(frame->size < UART_COBS_TYPE_SIZE)
+		{
+			h->rx_count++;
+			return pdFALSE;
+		}
+		type = *(uint8_t *) frame->data;
+		frame->data = (uint8_t *) frame->data + UART_COBS_TYPE_SIZE;
+		frame->size -= UART_COBS_TYPE_SIZE;
+	}
+	switch(type)
+	{
+	case UART_COBS_TYPE_DATA:
+		h->rx_count++;
+		if(!h->reliable)
+			return pdTRUE;
+		if(frame->size < UART_COBS_SEQ_SIZE)
+			return pdFALSE;
+		seq = *(uint8_t *) frame->data;
+		frame->data = (uint8_t *) frame->data + UART_COBS_SEQ_SIZE;
+		frame->size -= UART_COBS_SEQ_SIZE;
+		/* Sequence of peer is not known before reset */
+		if(!h->rx_synced)
+			return pdFALSE;
+		if(seq == h->rx_expected)
+			return pdTRUE;
+		/* Duplicate means ACK was lost, gap means data was lost, the
+		 * gap is reported once */
+		if((int8_t) (seq - h->rx_expected) < 0)
+			uart_cobs_tx_wake(h, UART_COBS_TX_ACK);
+		else if(!h->rx_nacked)
+		{
+			h->rx_nacked = 1;
+			uart_cobs_tx_wake(h, UART_COBS_TX_NACK);
+		}
+		break;
+	case UART_COBS_TYPE_CREDIT:
+		if(frame->size != UART_COBS_CREDIT_SIZE)
+			break;
+		memcpy(&limit, frame->data, sizeof(limit));
+		memcpy(&sent, (uint8_t *) frame->data + sizeof(limit),
+			sizeof(sent));
+		h->tx_limit = limit;
+		/* Data frames the peer sent before are in or lost for good, so
+		 * its count is taken over. Frames lost, merged or split and a
+		 * restart of the peer no longer skew the next limit. */
+		h->rx_count = sent;
+		uart_cobs_tx_wake(h, 0);
+		break;
+	case UART_COBS_TYPE_ACK:
+	case UART_COBS_TYPE_NACK:
+		if(frame->size != UART_COBS_ACK_SIZE)
+			break;
+		h->tx_acked = *(uint8_t *) frame->data;
+		uart_cobs_tx_wake(h,
+			(type == UART_COBS_TYPE_NACK) ? UART_COBS_TX_RESEND : 0);
+		break;
+	case UART_COBS_TYPE_RESET:
+	case UART_COBS_TYPE_RESET_ACK:
+		if(frame->size != UART_COBS_RESET_SIZE || !h->reliable)
+			break;
+		/* Reset of peer starting over is always taken, an answer only
+		 * if no reset came before. The answer lets data of this end go */
+		if(type == UART_COBS_TYPE_RESET_ACK)
+			h->tx_synced = 1;
+		if(type == UART_COBS_TYPE_RESET || !h->rx_synced)
+		{
+			h->rx_expected = *(uint8_t *) frame->data;
+			memcpy(&limit, (uint8_t *) frame->data + UART_COBS_SEQ_SIZE,
+				sizeof(limit));
+			h->rx_count = limit;
+			h->rx_nacked = 0;
+			h->rx_synced = 1;
+		}
+		uart_cobs_tx_wake(h,
+			(type == UART_COBS_TYPE_RESET) ? UART_COBS_TX_RESET_ACK : 0);
+		break;
+	case UART_COBS_TYPE_BAUD:
+	case UART_COBS_TYPE_BAUD_ACK:
+	case UART_COBS_TYPE_BAUD_CHECK:
+		if(frame->size != UART_COBS_BAUD_SIZE || h->baud_max == 0)
+			break;
+		memcpy(&rate, frame->data, UART_COBS_BAUD_SIZE);
+		h->baud_peer = rate;
+		if(type == UART_COBS_TYPE_BAUD)
+			uart_cobs_tx_wake(h, UART_COBS_TX_BAUD);
+		else if(type == UART_COBS_TYPE_BAUD_ACK)
+			uart_cobs_tx_wake(h, UART_COBS_TX_BAUD_ACK);
+		else
+			uart_cobs_tx_wake(h, UART_COBS_TX_BAUD_CHECK);
+		break;
+	default:
+		break;
+	}
+	return pdFALSE;
+}
+
+/* Frame is delivered, in reliable delivery it is acknowledged */
+static void uart_cobs_rx_accept(uart_cobs_service_t* h)
+{
+	if(!h->reliable)
+		return;
+	h->rx_expected++;
+	h->rx_nacked = 0;
+	uart_cobs_tx_wake(h, UART_COBS_TX_ACK);
+}
+
+/* Queue of received frame, channel byte is stripped. NULL if channel
+ * is not configured. "owner" is channel + 1, 1 without channels */
+static QueueHandle_t uart_cobs_rx_route(uart_cobs_service_t* h,
+	uart_cobs_frame_t* frame, uint8_t* owner)
+{
+	uint8_t channel = 0;
+	*owner = 1;
+	if(h->channels == NULL)
+		return h->output_queue;
+	if(frame->size < UART_COBS_CHANNEL_SIZE)
+		return NULL;
+	channel = *(uint8_t *) frame->data;
+	frame->data = (uint8_t *) frame->data + UART_COBS_CHANNEL_SIZE;
+	frame->size -= UART_COBS_CHANNEL_SIZE;
+	if(channel >= h->channel_count)
+		return NULL;
+	*owner = channel + 1;
+	return h->channels[channel].queue;
+}
+
+/* RX task state */
+struct uart_cobs_rx
+{
+	const framer_t		*framer;
+	framer_decoder_t	decoder;
+	/* frame being received into slot held by task */
+	uart_cobs_frame_t	frame;
+	size_t				payload_size;
+	size_t				buffer_size;
+	uint8_t				inplace;
+	/* framers that do not decode in place receive here */
+	uint8_t				*staging;
+	size_t				staging_size;
+	/* where next bytes are received */
+	uint8_t				*buf;
+	size_t				space;
+	/* CRC of frame being decoded */
+	struct uart_cobs_rx_crc	crc;
+	/* single task mode: set by DMA complete or IDLE, task to notify */
+	volatile uint8_t	ready;
+	TaskHandle_t		task;
+};
+
+/* Create output or channel queues and slot pool */
+static void uart_cobs_rx_init(uart_cobs_service_t* h, struct uart_cobs_rx* rx)
+{
+	uart_cobs_arena_t* arena = uart_cobs_rx_arena(h);
+	/* Every channel queue may fill up while one more frame is received */
+	size_t slots = h->queue_depth;
+	if(h->channels != NULL)
+	{
+		slots = 0;
+		for(size_t i = 0; i < h->channel_count; i++)
+		{
+			h->channels[i].queue = uart_cobs_queue_create(arena,
+				h->channels[i].queue_depth, sizeof(uart_cobs_frame_t));
+			h->channels[i].held = 0;
+			slots += h->channels[i].queue_depth;
+		}
+	}
+	else
+		h->output_queue = uart_cobs_queue_create(arena, h->queue_depth,
+			sizeof(uart_cobs_frame_t));
+	/* Frame buffer, frames are received and decoded in place,
+	 * so every slot holds the largest encoded frame. Frames of framers
+	 * that do not decode in place are received into a staging buffer
+	 * of the largest encoded frame, so DMA runs as long as in place,
+	 * and decoded into the slot. One slot is held by the task, the
+	 * others wait in free queue or are held by consumers. */
+	rx->framer = uart_cobs_framer(h);
+	rx->payload_size = uart_cobs_payload_size(h);
+	rx->inplace = (rx->framer->decode != NULL);
+	rx->buffer_size = rx->payload_size;
+	rx->staging = NULL;
+	rx->staging_size = 0;
+	if(rx->inplace)
+		rx->buffer_size = rx->framer->max_encoded_size(rx->payload_size);
+	else
+	{
+		rx->staging_size = rx->framer->max_encoded_size(rx->payload_size);
+		rx->staging = uart_cobs_alloc(arena, rx->staging_size);
+	}
+	uint8_t* framebuffer = uart_cobs_alloc(arena, (slots + 1)*rx->buffer_size);
+	h->rx_pool = framebuffer;
+	h->rx_slot_size = rx->buffer_size;
+	h->rx_slots = slots + 1;
+	h->rx_owned = uart_cobs_alloc(arena, slots + 1);
+	memset(h->rx_owned, 0, slots + 1);
+	h->free_queue = uart_cobs_queue_create(arena, slots + 1, sizeof(void *));
+	void* slot = NULL;
+	for(size_t i = 1; i <= slots; i++)
+	{
+		slot = &framebuffer[i*rx->buffer_size];
+		xQueueSend(h->free_queue, &slot, 0);
+	}
+	if(h->crc != UART_COBS_CRC_NONE
+		&& crc_freertos_init() == CRC_FREERTOS_ERR) Error_Handler();
+	h->rx_synced = 0;
+	h->rx_count = 0;
+	h->tx_limit = 0;
+	rx->crc.active = 0;
+	rx->frame.data = (void *) framebuffer;
+	rx->frame.size = 0;
+	rx->ready = 0;
+	rx->task = NULL;
+	framer_decoder_init(&rx->decoder, rx->framer, rx->frame.data,
+		rx->payload_size);
+}
+
+/* Receive right behind decoded part of the frame */
+static void uart_cobs_rx_buffer(struct uart_cobs_rx* rx)
+{
+	if(rx->inplace)
+	{
+		rx->buf = &rx->decoder.buffer.output[rx->decoder.buffer.length];
+		rx->space = rx->buffer_size - rx->decoder.buffer.length;
+	}
+	else
+	{
+		rx->buf = rx->staging;
+		rx->space = rx->staging_size;
+	}
+}
+
+/* High-water mark of slots held by consumers, free queue has room for
+ * every slot and the one held by task */
+static void uart_cobs_rx_held(uart_cobs_service_t* h)
+{
+	UBaseType_t held = uxQueueSpacesAvailable(h->free_queue) - 1;
+	if(held > h->stats.rx_held_max)
+		h->stats.rx_held_max = held;
+}
+
+/* Decode "size" bytes received into buffer, chunk may hold several
+ * frames */
+static void uart_cobs_rx_decode(uart_cobs_service_t* h,
+	struct uart_cobs_rx* rx, size_t size)
+{
+	const framer_t* framer = rx->framer;
+	framer_decoder_t* decoder = &rx->decoder;
+	uint8_t* buf = rx->buf;
+	uart_cobs_frame_t delivered = {.data = NULL, .size = 0};
+	QueueHandle_t queue = NULL;
+	BaseType_t deliver = pdFALSE;
+	uart_cobs_dispatch_t* entry = NULL;
+	uint8_t* delimiter = NULL;
+	struct uart_cobs_rx_crc* rx_crc = &rx->crc;
+	framer_status result = FRAMER_MORE;
+	size_t consumed = 0;
+	size_t index = 0;
+	uint8_t owner = 0;
+	void* slot = NULL;
+	uart_cobs_dispatch_sweep(h);
+	h->stats.rx_bytes += size;
+	while(size > 0)
+	{
+		/* Frame received at once is decoded in a single pass,
+		 * frame split between chunks goes through the decoder */
+		delimiter = NULL;
+		if(buf == decoder->buffer.output && !framer_decoder_pending(decoder))
+			delimiter = memchr(buf, framer->delimiter, size);
+		/* Empty frames between delimiters are only padding, as in the
+		 * streaming decoder */
+		if(delimiter == buf)
+		{
+			consumed = 1;
+			while(consumed < size && buf[consumed] == framer->delimiter)
+				consumed++;
+			size -= consumed;
+			memmove(buf, &buf[consumed], size);
+			continue;
+		}
+		/* CRC unit is fed while the frame is decoded, by every framer */
+		if(h->crc != UART_COBS_CRC_NONE && !rx_crc->active)
+		{
+			rx_crc->fed = decoder->buffer.output;
+			rx_crc->active = 1;
+			uart_cobs_crc_begin(h, &rx_crc->crc);
+		}
+		if(delimiter != NULL)
+		{
+			consumed = delimiter - buf + 1;
+			rx->frame.size = framer->decode(buf, consumed - 1, buf,
+				rx_crc->active ? uart_cobs_rx_crc_hook : NULL, rx_crc);
+			if(rx->frame.size <= rx->payload_size)
+				result = FRAMER_FRAME;
+			else
+				result = FRAMER_ERROR;
+		}
+		else
+		{
+			result = framer_decoder_feed(decoder, buf, size, &consumed);
+			rx->frame.size = decoder->buffer.length;
+			if(rx_crc->active)
+				uart_cobs_rx_crc_hook(rx_crc, decoder->buffer.output,
+					rx->frame.size);
+		}
+		size -= consumed;
+		/* CRC unit is not held while the rest of the frame is awaited */
+		if(result == FRAMER_MORE)
+		{
+			if(rx_crc->active && framer_decoder_pending(decoder))
+				crc_freertos_release(&rx_crc->crc);
+			else if(rx_crc->active)
+			{
+				crc_freertos_end(&rx_crc->crc);
+				rx_crc->active = 0;
+			}
+			break;
+		}
+		if(result == FRAMER_FRAME
+			&& uart_cobs_crc_check(h, &rx->frame, rx_crc) == pdFALSE)
+		{
+			h->stats.crc_errors++;
+			result = FRAMER_ERROR;
+		}
+		else if(result == FRAMER_ERROR)
+		{
+			/* CRC unit is given back */
+			if(rx_crc->active)
+				crc_freertos_end(&rx_crc->crc);
+			h->stats.decode_errors++;
+		}
+		rx_crc->active = 0;
+		/* Malformed frame counts as data, the peer most likely took
+		 * a credit for it */
+		delivered = rx->frame;
+		deliver = pdFALSE;
+		if(result == FRAMER_FRAME)
+			deliver = uart_cobs_rx_header(h, &delivered);
+		else
+			h->rx_count++;
+		/* Frame is handed over only with a free slot to continue in,
+		 * full channel queue does not hold up other channels */
+		if(deliver == pdTRUE)
+		{
+			queue = uart_cobs_rx_route(h, &delivered, &owner);
+			entry = NULL;
+			if(queue != NULL && delivered.size != 0)
+				entry = uart_cobs_dispatch_find(h,
+					*(uint8_t *) delivered.data);
+			/* Handler works on the frame in place, slot is kept */
+			if(entry != NULL && entry->handler != NULL)
+			{
+				entry->handler(entry->arg, delivered.data, delivered.size);
+				uart_cobs_rx_accept(h);
+				h->stats.rx_frames++;
+			}
+			else
+			{
+				if(entry != NULL)
+					queue = entry->queue;
+				if(queue == NULL)
+					h->stats.rx_dropped++;
+				/* Full channel drops its own frames */
+				else if(uart_cobs_rx_claim(h, owner) == pdFALSE)
+					h->stats.rx_dropped++;
+				/* Single task mode never blocks, TX runs in it */
+				else if(xQueueReceive(h->free_queue, &slot,
+					(h->rx_full == UART_COBS_RX_BLOCK && h->task == NULL)
+					? portMAX_DELAY : 0) == pdFALSE)
+				{
+					uart_cobs_rx_unclaim(h, owner);
+					h->stats.rx_dropped++;
+				}
+				else
+				{
+					/* Consumer owns the slot once it is queued */
+					index = ((uint8_t *) rx->frame.data - h->rx_pool)
+						/ h->rx_slot_size;
+					h->rx_owned[index] = owner;
+					if(xQueueSend(queue, &delivered, 0) == pdFALSE)
+					{
+						h->rx_owned[index] = 0;
+						uart_cobs_rx_unclaim(h, owner);
+						xQueueSend(h->free_queue, &slot, 0);
+						h->stats.rx_dropped++;
+					}
+					else
+					{
+						rx->frame.data = slot;
+						uart_cobs_rx_accept(h);
+						h->stats.rx_frames++;
+						uart_cobs_rx_held(h);
+					}
+				}
+			}
+		}
+		framer_decoder_init(decoder, framer, rx->frame.data, rx->payload_size);
+		/* Carry the rest of the chunk over to the beginning of the slot */
+		if(rx->inplace)
+		{
+			memmove(decoder->buffer.output, &buf[consumed], size);
+			buf = decoder->buffer.output;
+		}
+		else
+			buf += consumed;
+	}
+}
+
+/* Drop partial frame after gap timeout, it counts as malformed frame
+ * and the next byte starts a new frame */
+static void uart_cobs_rx_resync(uart_cobs_service_t* h,
+	struct uart_cobs_rx* rx)
+{
+	h->stats.rx_resyncs++;
+	h->rx_count++;
+	if(rx->crc.active)
+		crc_freertos_end(&rx->crc.crc);
+	rx->crc.active = 0;
+	framer_decoder_init(&rx->decoder, rx->framer, rx->frame.data,
+		rx->payload_size);
+}
+
+void uart_cobs_service_rx_task(void const * argument)
+{
+	uart_cobs_service_t* h = (uart_cobs_service_t *) argument;
+	struct uart_cobs_rx rx;
+	uart_cobs_rx_init(h, &rx);
+	uart_freertos_status_t status = {0};
+	size_t size = 0;
+	TickType_t timeout = portMAX_DELAY;
+	while(1)
+	{
+		uart_cobs_rx_buffer(&rx);
+		size = 0;
+		/* Rest of partial frame is awaited up to gap timeout */
+		timeout = portMAX_DELAY;
+		if(h->rx_gap_timeout != 0 && framer_decoder_pending(&rx.decoder))
+			timeout = h->rx_gap_timeout;
+		switch(h->mode)
+		{
+		case UART_COBS_POLLING:
+			status = uart_freertos_rx(h->huart, rx.buf,
+				sizeof(uint8_t), portMAX_DELAY, (timeout == portMAX_DELAY)
+				? HAL_MAX_DELAY : timeout*portTICK_PERIOD_MS);
+			switch(status.status)
+			{
+			case UART_FREERTOS_OK:
+				size = 1;
+			default:
+				break;
+			}
+			break;
+		case UART_COBS_INTERRUPT:
+			status = uart_freertos_rx_it(h->huart, rx.buf,
+				sizeof(uint8_t), portMAX_DELAY, timeout);
+			switch(status.status)
+			{
+			case UART_FREERTOS_OK:
+				size = 1;
+			default:
+				break;
+			}
+			break;
+		case UART_COBS_DMA:
+			status = uart_freertos_rx_dma_idle(h->huart, rx.buf, rx.space,
+				portMAX_DELAY, timeout, 1);
+			switch(status.status)
+			{
+			case UART_FREERTOS_OK:
+			case UART_FREERTOS_IDLE:
+				size = status.rx_size;
+			default:
+				break;
+			}
+			break;
+		default:
+			break;
+		}
+		if(size == 0 && timeout != portMAX_DELAY)
+			uart_cobs_rx_resync(h, &rx);
+		uart_cobs_rx_decode(h, &rx, size);
+	}
+}
+
+/* Take next queued frame, highest lane first. Each queued frame gives
+ * pending semaphore once, so a frame waits in one of the lanes. */
+static BaseType_t uart_cobs_tx_next(uart_cobs_service_t* h,
+	uart_cobs_tx_frame_t* frame, TickType_t timeout)
+{
+	UBaseType_t queued = 0;
+	if(xSemaphoreTake(h->tx_pending, timeout) == pdFALSE)
+		return pdFALSE;
+	for(size_t lane = 0; lane < UART_COBS_TX_LANES; lane++)
+		queued += uxQueueMessagesWaiting(h->input_queue[lane]);
+	if(queued > h->stats.tx_queued_max)
+		h->stats.tx_queued_max = queued;
+	for(size_t lane = UART_COBS_TX_LANES; lane-- > 0;)
+		if(xQueueReceive(h->input_queue[lane], frame, 0) == pdTRUE)
+			return pdTRUE;
+	return pdFALSE;
+}
+
+/* Account queue wait of frame to its lane */
+static void uart_cobs_tx_lane_wait(uart_cobs_service_t* h,
+	const uart_cobs_tx_frame_t* frame)
+{
+	uart_cobs_tx_lane_stats_t* stats = &h->stats.tx_lanes[frame->lane];
+	TickType_t wait = xTaskGetTickCount() - frame->queued;
+	h->stats.tx_frames++;
+	stats->frames++;
+	stats->wait_total += wait;
+	if(wait > stats->wait_max)
+		stats->wait_max = wait;
+}
+
+/* Peer has a free slot for a data frame */
+static inline BaseType_t uart_cobs_tx_credits(uart_cobs_service_t* h)
+{
+	if(!h->flow_control)
+		return pdTRUE;
+	return (int16_t) (h->tx_limit - h->tx_sent) > 0;
+}
 
-size_t uart_cobs_send(uart_cobs_service_t* h, void* data, size_t size,
-	TickType_t timeout)
+static inline TickType_t uart_cobs_credit_period(uart_cobs_service_t* h)
+{
+	if(h->credit_period == 0)
+		return UART_COBS_CREDIT_PERIOD;
+	return h->credit_period;
+}
+
+/* Ticks until credit frame is due, 0 - now. It is due early once the
+ * window advertised to peer shrinks below half of free slots. */
+static TickType_t uart_cobs_credit_due(uart_cobs_service_t* h)
 {
-	if(h->input_queue == NULL)
+	TickType_t period = uart_cobs_credit_period(h);
+	TickType_t elapsed = 0;
+	uint16_t limit = 0;
+	int16_t window = 0;
+	if(!h->flow_control)
+		return portMAX_DELAY;
+	limit = uart_cobs_rx_limit(h);
+	window = (int16_t) (h->rx_advertised - h->rx_count);
+	if(limit != h->rx_advertised
+		&& 2*window < (int16_t) (limit - h->rx_count))
 		return 0;
-	uart_cobs_frame_t frame;
-	frame.data = data;
-	frame.size = size;
-	if(xQueueSend(h->input_queue, &frame, timeout) == pdFALSE)
+	/* Count taken over from peer moved below the limit advertised */
+	if((int16_t) (h->rx_advertised - limit) > 0)
 		return 0;
+	elapsed = xTaskGetTickCount() - h->credit_tick;
+	if(elapsed >= period)
+		return 0;
+	return period - elapsed;
+}
+
+/* TX task state */
+struct uart_cobs_tx
+{
+	const framer_t			*framer;
+	/* DMA ring, NULL - not used */
+	struct uart_cobs_tx_ring	*ring;
+	/* frame taken from lanes but not sent yet, it waits for credit,
+	 * for room in window or did not fit into burst */
+	uart_cobs_tx_frame_t	frame;
+	uint8_t					carry;
+	/* credit, ACK, NACK or baud frame */
+	uart_cobs_tx_frame_t	control;
+	uint8_t					payload[UART_COBS_BAUD_SIZE];
+	/* reliable delivery window, frames from base up to next are not
+	 * acknowledged, frames from send up to next are sent next */
+	uart_cobs_tx_frame_t	*window;
+	uint8_t					*buffer;
+	uint8_t					size;
+	uint8_t					base;
+	uint8_t					send;
+	uint8_t					next;
+	/* last progress of window and last reset sent */
+	TickType_t				tick;
+	TickType_t				reset_tick;
+	/* carried frame held back for credit or window since stall tick */
+	uint8_t					stalled;
+	TickType_t				stall_tick;
+	/* stats frame, type, version and snapshot of stats */
+	TickType_t				stats_tick;
+	uint8_t					stats[UART_COBS_STATS_SIZE];
+	/* baud rate negotiation, rate negotiated and rate to fall back to
+	 * since state tick */
+	uint8_t					baud_state;
+	uint8_t					baud_proposer;
+	uint32_t				baud_rate;
+	uint32_t				baud_fallback;
+	TickType_t				baud_tick;
+	TickType_t				baud_check_tick;
+	/* baud frame sent next, UART switches to "after" rate once it is
+	 * sent and to "switch" rate once frames before are out, 0 - none */
+	uint8_t					baud_reply;
+	uint32_t				baud_reply_rate;
+	uint32_t				baud_after;
+	uint32_t				baud_switch;
+};
+
+/* Make control frame of "type", credit frame advertises receive limit,
+ * ACK and NACK the next sequence number expected, reset and its answer
+ * the oldest frame of window and data frames sent, baud frames the
+ * rate of reply */
+static const uart_cobs_tx_frame_t* uart_cobs_tx_control(
+	uart_cobs_service_t* h, struct uart_cobs_tx* tx, uint8_t type)
+{
+	uart_cobs_tx_frame_t* frame = &tx->control;
+	frame->data = tx->payload;
+	frame->count = 0;
+	frame->done = NULL;
+	frame->arg = NULL;
+	frame->channel = 0;
+	frame->lane = 0;
+	frame->queued = xTaskGetTickCount();
+	frame->type = type;
+	frame->seq = 0;
+	if(type == UART_COBS_TYPE_CREDIT)
+	{
+		h->rx_advertised = uart_cobs_rx_limit(h);
+		h->credit_tick = frame->queued;
+		memcpy(tx->payload, &h->rx_advertised, sizeof(h->rx_advertised));
+		memcpy(&tx->payload[sizeof(h->rx_advertised)], &h->tx_sent,
+			sizeof(h->tx_sent));
+		frame->size = UART_COBS_CREDIT_SIZE;
+	}
+	else if(type == UART_COBS_TYPE_ACK || type == UART_COBS_TYPE_NACK)
+	{
+		tx->payload[0] = h->rx_expected;
+		frame->size = UART_COBS_ACK_SIZE;
+	}
+	else if(type == UART_COBS_TYPE_RESET || type == UART_COBS_TYPE_RESET_ACK)
+	{
+		tx->payload[0] = tx->base;
+		memcpy(&tx->payload[UART_COBS_SEQ_SIZE], &h->tx_sent,
+			sizeof(h->tx_sent));
+		frame->size = UART_COBS_RESET_SIZE;
+	}
 	else
-		return size;
+	{
+		memcpy(tx->payload, &tx->baud_reply_rate, UART_COBS_BAUD_SIZE);
+		frame->size = UART_COBS_BAUD_SIZE;
+	}
+	return frame;
 }
 
-size_t uart_cobs_recv(uart_cobs_service_t* h, void** data, TickType_t timeout)
+/* Window size is a power of two, so slots follow sequence numbers
+ * across wrap */
+static uint8_t uart_cobs_tx_window_size(uart_cobs_service_t* h)
 {
-	if(h->output_queue == NULL)
+	uint8_t want = h->tx_window;
+	uint8_t size = 1;
+	if(want == 0)
+		want = UART_COBS_TX_WINDOW;
+	while(size < 128 && 2*size <= want)
+		size *= 2;
+	return size;
+}
+
+static inline TickType_t uart_cobs_retransmit_timeout(uart_cobs_service_t* h)
+{
+	if(h->retransmit_timeout == 0)
+		return UART_COBS_RETRANSMIT_TIMEOUT;
+	return h->retransmit_timeout;
+}
+
+/* Allocate window of reliable delivery, every frame has a slot of
+ * largest payload */
+static void uart_cobs_tx_window_create(uart_cobs_service_t* h,
+	struct uart_cobs_tx* tx)
+{
+	/* Sequence numbers of corrupted frames must not get through */
+	if(h->crc == UART_COBS_CRC_NONE) Error_Handler();
+	tx->size = uart_cobs_tx_window_size(h);
+	tx->window = uart_cobs_alloc(uart_cobs_tx_arena(h),
+		tx->size*sizeof(uart_cobs_tx_frame_t));
+	tx->buffer = uart_cobs_alloc(uart_cobs_tx_arena(h),
+		tx->size*h->max_frame_size);
+}
+
+/* Move window up to sequence number acknowledged by peer, ACK outside
+ * of window is stale */
+static void uart_cobs_tx_window_ack(uart_cobs_service_t* h,
+	struct uart_cobs_tx* tx)
+{
+	uint8_t acked = h->tx_acked;
+	if(acked == tx->base
+		|| (uint8_t) (acked - tx->base) > (uint8_t) (tx->next - tx->base))
+		return;
+	tx->base = acked;
+	tx->tick = xTaskGetTickCount();
+	if((uint8_t) (tx->send - tx->base) > (uint8_t) (tx->next - tx->base))
+		tx->send = tx->base;
+}
+
+/* Copy carried frame into window, producer may reuse its data */
+static const uart_cobs_tx_frame_t* uart_cobs_tx_window_put(
+	uart_cobs_service_t* h, struct uart_cobs_tx* tx)
+{
+	size_t index = tx->next & (tx->size - 1);
+	uart_cobs_tx_frame_t* frame = &tx->window[index];
+	uint8_t* slot = &tx->buffer[index*h->max_frame_size];
+	const cobs_segment_t* segments = (const cobs_segment_t *) tx->frame.data;
+	size_t offset = 0;
+	if(tx->frame.count)
+	{
+		for(size_t i = 0; i < tx->frame.count; i++)
+		{
+			memcpy(&slot[offset], segments[i].data, segments[i].size);
+			offset += segments[i].size;
+		}
+	}
+	else
+		memcpy(slot, tx->frame.data, tx->frame.size);
+	if(tx->frame.done)
+		tx->frame.done(tx->frame.arg, tx->frame.data);
+	*frame = tx->frame;
+	frame->data = slot;
+	frame->count = 0;
+	frame->done = NULL;
+	frame->seq = tx->next;
+	if(tx->base == tx->next)
+		tx->tick = xTaskGetTickCount();
+	tx->next++;
+	return frame;
+}
+
+/* Largest encoded size of queued frame */
+static inline size_t uart_cobs_tx_max_size(uart_cobs_service_t* h,
+	const framer_t* framer, const uart_cobs_tx_frame_t* frame)
+{
+	return framer->max_encoded_size(frame->size + uart_cobs_overhead(h));
+}
+
+/* Ticks until stats frame is due, portMAX_DELAY if there is none */
+static TickType_t uart_cobs_stats_due(uart_cobs_service_t* h,
+	struct uart_cobs_tx* tx)
+{
+	TickType_t elapsed = 0;
+	if(h->stats_period == 0 || sizeof(tx->stats) > h->max_frame_size)
+		return portMAX_DELAY;
+	elapsed = xTaskGetTickCount() - tx->stats_tick;
+	if(elapsed >= h->stats_period)
 		return 0;
-	uart_cobs_frame_t frame = {.data = NULL, .size = 0};
-	xQueueReceive(h->output_queue, &frame, timeout);
-	*data = frame.data;
-	return frame.size;
+	return h->stats_period - elapsed;
 }
 
-void uart_cobs_service_rx_task(void const * argument)
+/* Write "size" bytes of "value" little endian, returns next byte */
+static uint8_t* uart_cobs_put_le(uint8_t* out, uint32_t value, size_t size)
 {
-	uart_cobs_service_t* h = (uart_cobs_service_t *) argument;
-	h->output_queue = xQueueCreate(h->queue_depth, sizeof(uart_cobs_frame_t));
-	/* Frame buffer */
-	uint8_t* framebuffer = pvPortMalloc(h->queue_depth*h->max_frame_size);
-	if(!framebuffer) Error_Handler();
-	/* Buffer for COBS */
-	size_t cobs_buffer_size = h->max_frame_size + h->max_frame_size/254 + 2;
-	uint8_t *buf = pvPortMalloc(cobs_buffer_size);
-	if(!buf) Error_Handler();
-	uart_freertos_status_t status = {0};
-	size_t size = 0;
-	/* Data frame handler */
-	uart_cobs_frame_t frame = {.data = NULL, .size = 0};
-	frame.data = (void *) framebuffer;
-	while(1)
+	while(size-- > 0)
 	{
-		size = 0;
-		do
+		*out++ = (uint8_t) value;
+		value >>= 8;
+	}
+	return out;
+}
+
+/* Serialize stats into "out" of UART_COBS_STATS_SIZE bytes */
+static void uart_cobs_stats_pack(const uart_cobs_stats_t* stats,
+	uint8_t* out)
+{
+	size_t i = 0;
+	*out++ = UART_COBS_STATS_TYPE;
+	*out++ = UART_COBS_STATS_VERSION;
+	out = uart_cobs_put_le(out, stats->rx_bytes, 4);
+	out = uart_cobs_put_le(out, stats->rx_frames, 4);
+	out = uart_cobs_put_le(out, stats->tx_bytes, 4);
+	out = uart_cobs_put_le(out, stats->tx_frames, 4);
+	out = uart_cobs_put_le(out, stats->decode_errors, 4);
+	out = uart_cobs_put_le(out, stats->crc_errors, 4);
+	out = uart_cobs_put_le(out, stats->rx_dropped, 4);
+	out = uart_cobs_put_le(out, stats->rx_resyncs, 4);
+	out = uart_cobs_put_le(out, stats->retransmits, 4);
+	out = uart_cobs_put_le(out, stats->rx_held_max, 2);
+	out = uart_cobs_put_le(out, stats->tx_queued_max, 2);
+	out = uart_cobs_put_le(out, stats->tx_stall, 4);
+	out = uart_cobs_put_le(out, stats->tx_errors, 4);
+	for(i = 0; i < UART_COBS_TX_LANES; i++)
+	{
+		out = uart_cobs_put_le(out, stats->tx_lanes[i].frames, 4);
+		out = uart_cobs_put_le(out, stats->tx_lanes[i].wait_total, 4);
+		out = uart_cobs_put_le(out, (uint32_t) stats->tx_lanes[i].wait_max, 4);
+	}
+}
+
+/* Carry stats frame as if taken from lane 0 */
+static void uart_cobs_tx_stats(uart_cobs_service_t* h,
+	struct uart_cobs_tx* tx)
+{
+	uart_cobs_stats_t stats;
+	tx->stats_tick = xTaskGetTickCount();
+	uart_cobs_get_stats(h, &stats);
+	uart_cobs_stats_pack(&stats, tx->stats);
+	memset(&tx->frame, 0, sizeof(tx->frame));
+	tx->frame.data = tx->stats;
+	tx->frame.size = sizeof(tx->stats);
+	tx->frame.type = UART_COBS_TYPE_DATA;
+	tx->frame.queued = tx->stats_tick;
+	tx->carry = 1;
+}
+
+/* Account time carried frame is held back for credit or window */
+static void uart_cobs_tx_stall(uart_cobs_service_t* h,
+	struct uart_cobs_tx* tx, uint8_t stalled)
+{
+	TickType_t now = xTaskGetTickCount();
+	if(stalled && !tx->stalled)
+		tx->stall_tick = now;
+	else if(!stalled && tx->stalled)
+		h->stats.tx_stall += now - tx->stall_tick;
+	tx->stalled = stalled;
+}
+
+static inline TickType_t uart_cobs_baud_timeout(uart_cobs_service_t* h)
+{
+	if(h->baud_timeout == 0)
+		return UART_COBS_BAUD_TIMEOUT;
+	return h->baud_timeout;
+}
+
+/* Ticks between check frames of proposer, the last one goes before
+ * timeout, one tick at least */
+static inline TickType_t uart_cobs_baud_check_period(uart_cobs_service_t* h)
+{
+	TickType_t period = uart_cobs_baud_timeout(h) / (UART_COBS_BAUD_CHECKS + 1);
+	return (period != 0) ? period : 1;
+}
+
+/* End negotiation of uart_cobs_set_baud() with "rate", 0 - failed */
+static void uart_cobs_baud_result(uart_cobs_service_t* h, uint32_t rate)
+{
+	h->baud_result = rate;
+	h->baud_request = 0;
+	xSemaphoreGive(h->baud_done);
+}
+
+/* Advance negotiation on requests and timeouts. Answer to proposal
+ * goes at the old rate, UART switches once it is out. Proposer
+ * switches on the answer and checks the new rate, the answer to the
+ * check settles it for proposer, which confirms with BAUD_ACK. Peer
+ * settles on the confirm. Data frames wait until the rate is
+ * settled. */
+static void uart_cobs_tx_baud(uart_cobs_service_t* h,
+	struct uart_cobs_tx* tx, uint8_t control)
+{
+	TickType_t now = xTaskGetTickCount();
+	uint32_t current = h->huart->huart->Init.BaudRate;
+	uint32_t rate = h->baud_peer;
+	if(control & UART_COBS_TX_BAUD_START)
+	{
+		if(tx->baud_state != UART_COBS_BAUD_IDLE)
+			uart_cobs_baud_result(h, 0);
+		else if(h->baud_request == current)
+			uart_cobs_baud_result(h, current);
+		else
 		{
-			switch(h->mode)
-			{
-			case UART_COBS_POLLING:
-				status = uart_freertos_rx(h->huart, &(buf[size]),
-					sizeof(uint8_t), portMAX_DELAY, HAL_MAX_DELAY);
-				switch(status.status)
-				{
-				case UART_FREERTOS_OK:
-					size++;
-				default:
-					break;
-				}
-				break;
-			case UART_COBS_INTERRUPT:
-				status = uart_freertos_rx_it(h->huart, &(buf[size]),
-					sizeof(uint8_t), portMAX_DELAY, portMAX_DELAY);
-				switch(status.status)
-				{
-				case UART_FREERTOS_OK:
-					size++;
-				default:
-					break;
-				}
-				break;
-			case UART_COBS_DMA:
-				status = uart_freertos_rx_dma_idle(h->huart, &(buf[size]),
-					cobs_buffer_size-size, portMAX_DELAY, portMAX_DELAY, 1);
-				switch(status.status)
-				{
-				case UART_FREERTOS_OK:
-				case UART_FREERTOS_IDLE:
-					size += status.rx_size;
-				default:
-					break;
-				}
-				break;
-			default:
-				break;
-			}
-			if(size >= cobs_buffer_size) size = 0;
-		} while(buf[size-1] != 0x00);
-		size--;
-		frame.size = cobs_decode(buf, size, frame.data);
-		xQueueSend(h->output_queue, &frame, portMAX_DELAY);
-		frame.data += h->max_frame_size;
-		if(frame.data-((void *)framebuffer) >= h->queue_depth*h->max_frame_size)
-			frame.data = (void *) framebuffer;
+			tx->baud_state = UART_COBS_BAUD_PROPOSED;
+			tx->baud_proposer = 1;
+			tx->baud_rate = h->baud_request;
+			tx->baud_tick = now;
+			tx->baud_reply = UART_COBS_TYPE_BAUD;
+			tx->baud_reply_rate = tx->baud_rate;
+		}
+	}
+	/* Proposal of peer is refused while negotiating, above maximum
+	 * or if USART can not run at it */
+	if(control & UART_COBS_TX_BAUD)
+	{
+		tx->baud_reply = UART_COBS_TYPE_BAUD_ACK;
+		tx->baud_reply_rate = 0;
+		if(tx->baud_state == UART_COBS_BAUD_IDLE && rate != 0
+			&& rate <= h->baud_max
+			&& uart_freertos_check_baud(h->huart, rate) == UART_FREERTOS_OK)
+		{
+			tx->baud_state = UART_COBS_BAUD_CHECK;
+			tx->baud_proposer = 0;
+			tx->baud_rate = rate;
+			tx->baud_fallback = current;
+			tx->baud_tick = now;
+			tx->baud_reply_rate = rate;
+			tx->baud_after = rate;
+		}
+	}
+	/* Answer of peer, to proposal first, then to check at new rate */
+	if((control & UART_COBS_TX_BAUD_ACK) && tx->baud_proposer)
+	{
+		if(tx->baud_state == UART_COBS_BAUD_PROPOSED && rate == 0)
+		{
+			tx->baud_state = UART_COBS_BAUD_IDLE;
+			uart_cobs_baud_result(h, 0);
+		}
+		else if(tx->baud_state == UART_COBS_BAUD_PROPOSED
+			&& rate == tx->baud_rate)
+		{
+			tx->baud_state = UART_COBS_BAUD_CHECK;
+			tx->baud_fallback = current;
+			tx->baud_tick = now;
+			tx->baud_check_tick = now;
+			tx->baud_switch = rate;
+		}
+		/* Answer to check settles the rate and is confirmed, again
+		 * if peer repeats it while the confirm is lost */
+		else if((tx->baud_state == UART_COBS_BAUD_CHECK
+			&& rate == tx->baud_rate)
+			|| (tx->baud_state == UART_COBS_BAUD_IDLE && rate == current))
+		{
+			if(tx->baud_state == UART_COBS_BAUD_CHECK)
+				uart_cobs_baud_result(h, rate);
+			tx->baud_state = UART_COBS_BAUD_IDLE;
+			tx->baud_reply = UART_COBS_TYPE_BAUD_ACK;
+			tx->baud_reply_rate = rate;
+		}
+	}
+	/* Confirm of proposer settles the rate */
+	if((control & UART_COBS_TX_BAUD_ACK) && !tx->baud_proposer
+		&& tx->baud_state == UART_COBS_BAUD_CONFIRM && rate == tx->baud_rate)
+		tx->baud_state = UART_COBS_BAUD_IDLE;
+	/* Check of proposer, answered again if the answer was lost. Peer
+	 * keeps the old rate to fall back to until the confirm */
+	if((control & UART_COBS_TX_BAUD_CHECK) && !tx->baud_proposer
+		&& (tx->baud_state == UART_COBS_BAUD_CHECK
+		|| tx->baud_state == UART_COBS_BAUD_CONFIRM)
+		&& rate == tx->baud_rate)
+	{
+		if(tx->baud_state == UART_COBS_BAUD_CHECK)
+			tx->baud_tick = now;
+		tx->baud_state = UART_COBS_BAUD_CONFIRM;
+		tx->baud_check_tick = now;
+		tx->baud_reply = UART_COBS_TYPE_BAUD_ACK;
+		tx->baud_reply_rate = rate;
+	}
+	/* Both ends fall back on their own without a check answered or
+	 * confirmed */
+	if(tx->baud_state != UART_COBS_BAUD_IDLE
+		&& now - tx->baud_tick >= uart_cobs_baud_timeout(h))
+	{
+		if(tx->baud_state != UART_COBS_BAUD_PROPOSED)
+			tx->baud_switch = tx->baud_fallback;
+		tx->baud_state = UART_COBS_BAUD_IDLE;
+		tx->baud_reply = 0;
+		tx->baud_after = 0;
+		if(tx->baud_proposer)
+			uart_cobs_baud_result(h, 0);
+	}
+	/* Proposer repeats its check, peer its answer until confirmed */
+	else if(((tx->baud_state == UART_COBS_BAUD_CHECK && tx->baud_proposer)
+		|| tx->baud_state == UART_COBS_BAUD_CONFIRM)
+		&& now - tx->baud_check_tick >= uart_cobs_baud_check_period(h))
+	{
+		tx->baud_check_tick = now;
+		tx->baud_reply = tx->baud_proposer ? UART_COBS_TYPE_BAUD_CHECK
+			: UART_COBS_TYPE_BAUD_ACK;
+		tx->baud_reply_rate = tx->baud_rate;
+	}
+}
+
+/* Ticks until negotiation times out or the next check is due,
+ * portMAX_DELAY if there is none */
+static TickType_t uart_cobs_baud_due(uart_cobs_service_t* h,
+	struct uart_cobs_tx* tx)
+{
+	TickType_t now = xTaskGetTickCount();
+	TickType_t timeout = uart_cobs_baud_timeout(h);
+	TickType_t elapsed = now - tx->baud_tick;
+	TickType_t due = 0;
+	if(tx->baud_switch != 0)
+		return 0;
+	if(tx->baud_state == UART_COBS_BAUD_IDLE)
+		return portMAX_DELAY;
+	if(elapsed >= timeout)
+		return 0;
+	due = timeout - elapsed;
+	if((tx->baud_state == UART_COBS_BAUD_CHECK && tx->baud_proposer)
+		|| tx->baud_state == UART_COBS_BAUD_CONFIRM)
+	{
+		timeout = uart_cobs_baud_check_period(h);
+		elapsed = now - tx->baud_check_tick;
+		if(elapsed >= timeout)
+			return 0;
+		if(timeout - elapsed < due)
+			due = timeout - elapsed;
+	}
+	return due;
+}
+
+/* Baud frame sent next, UART switches after it if it accepts a
+ * proposal */
+static const uart_cobs_tx_frame_t* uart_cobs_tx_baud_reply(
+	uart_cobs_service_t* h, struct uart_cobs_tx* tx)
+{
+	const uart_cobs_tx_frame_t* frame = uart_cobs_tx_control(h, tx,
+		tx->baud_reply);
+	tx->baud_reply = 0;
+	tx->baud_switch = tx->baud_after;
+	tx->baud_after = 0;
+	return frame;
+}
+
+/* Switch UART to negotiated or fallback rate, frames before are out.
+ * Negotiation is given up if the rate can not be set, UART stays at
+ * the old rate and the peer falls back on its own */
+static void uart_cobs_tx_baud_switch(uart_cobs_service_t* h,
+	struct uart_cobs_tx* tx)
+{
+	if(uart_freertos_set_baud(h->huart, tx->baud_switch) != UART_FREERTOS_OK
+		&& tx->baud_state != UART_COBS_BAUD_IDLE)
+	{
+		tx->baud_state = UART_COBS_BAUD_IDLE;
+		tx->baud_reply = 0;
+		if(tx->baud_proposer)
+			uart_cobs_baud_result(h, 0);
+	}
+	tx->baud_switch = 0;
+}
+
+/* Next frame to encode into "room" bytes, NULL if none may be sent
+ * now. Control frames go first, then frames to be resent, then the
+ * carried frame. */
+static const uart_cobs_tx_frame_t* uart_cobs_tx_pick(uart_cobs_service_t* h,
+	struct uart_cobs_tx* tx, size_t room)
+{
+	const uart_cobs_tx_frame_t* frame = NULL;
+	uint8_t control = 0;
+	/* Nothing is queued behind frames UART switches rate after */
+	if(tx->baud_switch != 0)
+		return NULL;
+	if(room < tx->framer->max_encoded_size(uart_cobs_overhead(h)
+		+ UART_COBS_BAUD_SIZE))
+		return NULL;
+	taskENTER_CRITICAL();
+	control = h->tx_control;
+	h->tx_control = 0;
+	taskEXIT_CRITICAL();
+	if(h->baud_max != 0)
+		uart_cobs_tx_baud(h, tx, control);
+	if(h->reliable)
+	{
+		uart_cobs_tx_window_ack(h, tx);
+		/* Peer started over, window goes out again from its oldest
+		 * frame and peer gets fresh credit */
+		if(control & UART_COBS_TX_RESET_ACK)
+		{
+			tx->send = tx->base;
+			tx->tick = xTaskGetTickCount();
+			h->rx_advertised = h->rx_count;
+			/* ACK and NACK wait for the answer to go out */
+			taskENTER_CRITICAL();
+			h->tx_control |= control & (UART_COBS_TX_ACK | UART_COBS_TX_NACK);
+			taskEXIT_CRITICAL();
+			return uart_cobs_tx_control(h, tx, UART_COBS_TYPE_RESET_ACK);
+		}
+		/* Reset is sent again until peer answers */
+		if(!h->tx_synced && xTaskGetTickCount() - tx->reset_tick
+			>= uart_cobs_retransmit_timeout(h))
+		{
+			tx->reset_tick = xTaskGetTickCount();
+			return uart_cobs_tx_control(h, tx, UART_COBS_TYPE_RESET);
+		}
+		/* Go back to the oldest frame on NACK or timeout */
+		if((control & UART_COBS_TX_RESEND) || (tx->base != tx->next
+			&& xTaskGetTickCount() - tx->tick
+			>= uart_cobs_retransmit_timeout(h)))
+		{
+			tx->send = tx->base;
+			tx->tick = xTaskGetTickCount();
+		}
+	}
+	if(control & UART_COBS_TX_NACK)
+		return uart_cobs_tx_control(h, tx, UART_COBS_TYPE_NACK);
+	if(control & UART_COBS_TX_ACK)
+		return uart_cobs_tx_control(h, tx, UART_COBS_TYPE_ACK);
+	if(uart_cobs_credit_due(h) == 0)
+		return uart_cobs_tx_control(h, tx, UART_COBS_TYPE_CREDIT);
+	if(tx->baud_reply != 0)
+		return uart_cobs_tx_baud_reply(h, tx);
+	if(tx->baud_state != UART_COBS_BAUD_IDLE)
+		return NULL;
+	if(!tx->carry && uart_cobs_stats_due(h, tx) == 0)
+		uart_cobs_tx_stats(h, tx);
+	/* Data waits for answer to reset */
+	if(h->reliable && !h->tx_synced)
+		return NULL;
+	if(!uart_cobs_tx_credits(h))
+	{
+		uart_cobs_tx_stall(h, tx, tx->carry);
+		return NULL;
+	}
+	if(h->reliable && tx->send != tx->next)
+	{
+		frame = &tx->window[tx->send & (tx->size - 1)];
+		if(room < uart_cobs_tx_max_size(h, tx->framer, frame))
+			return NULL;
+		tx->send++;
+		h->stats.retransmits++;
+		return frame;
+	}
+	if(!tx->carry || room < uart_cobs_tx_max_size(h, tx->framer, &tx->frame))
+		return NULL;
+	if(h->reliable && (uint8_t) (tx->next - tx->base) >= tx->size)
+	{
+		uart_cobs_tx_stall(h, tx, 1);
+		return NULL;
+	}
+	uart_cobs_tx_stall(h, tx, 0);
+	uart_cobs_tx_lane_wait(h, &tx->frame);
+	tx->carry = 0;
+	if(!h->reliable)
+		return &tx->frame;
+	frame = uart_cobs_tx_window_put(h, tx);
+	tx->send = tx->next;
+	return frame;
+}
+
+/* Ticks until TX task looks again without being woken */
+static TickType_t uart_cobs_tx_timeout(uart_cobs_service_t* h,
+	struct uart_cobs_tx* tx)
+{
+	TickType_t timeout = uart_cobs_credit_due(h);
+	TickType_t stats = uart_cobs_stats_due(h, tx);
+	TickType_t baud = uart_cobs_baud_due(h, tx);
+	TickType_t retransmit = 0;
+	TickType_t elapsed = 0;
+	if(stats < timeout)
+		timeout = stats;
+	if(baud < timeout)
+		timeout = baud;
+	if(h->reliable && tx->base != tx->next)
+	{
+		retransmit = uart_cobs_retransmit_timeout(h);
+		elapsed = xTaskGetTickCount() - tx->tick;
+		retransmit = (elapsed < retransmit) ? retransmit - elapsed : 0;
+		if(retransmit < timeout)
+			timeout = retransmit;
+	}
+	/* Reset is due again */
+	if(h->reliable && !h->tx_synced)
+	{
+		retransmit = uart_cobs_retransmit_timeout(h);
+		elapsed = xTaskGetTickCount() - tx->reset_tick;
+		retransmit = (elapsed < retransmit) ? retransmit - elapsed : 0;
+		if(retransmit < timeout)
+			timeout = retransmit;
+	}
+	/* Failed DMA start is retried next tick */
+	if(tx->ring != NULL && uart_cobs_tx_ring_stalled(tx->ring) == pdTRUE)
+		timeout = 1;
+	return timeout;
+}
+
+/* Encode queued frame into ring of "size" bytes at "output" starting
+ * at "start", size 0 for a linear buffer. Returns encoded length with
+ * delimiter, producer is told its data may be reused */
+static size_t uart_cobs_tx_encode(uart_cobs_service_t* h,
+	const framer_t* framer, const uart_cobs_tx_frame_t* frame,
+	uint8_t* output, size_t size, size_t start)
+{
+	const cobs_segment_t* segments = NULL;
+	cobs_segment_t single = {.data = NULL, .size = 0};
+	size_t count = 0;
+	framer_encoder_t encoder;
+	crc_freertos_t crc;
+	uint32_t crc_value = 0;
+	uint8_t header[UART_COBS_TYPE_SIZE + UART_COBS_SEQ_SIZE
+		+ UART_COBS_CHANNEL_SIZE];
+	size_t header_size = 0;
+	size_t length = frame->size;
+	if(frame->type == UART_COBS_TYPE_DATA)
+		h->tx_sent++;
+	if(frame->count)
+	{
+		segments = (const cobs_segment_t *) frame->data;
+		count = frame->count;
+	}
+	else
+	{
+		single.data = frame->data;
+		single.size = frame->size;
+		segments = &single;
+		count = 1;
+	}
+	/* Type, sequence number and channel lead the frame, control
+	 * frames have neither of the latter */
+	if(uart_cobs_typed(h))
+		header[header_size++] = frame->type;
+	if(h->reliable && frame->type == UART_COBS_TYPE_DATA)
+		header[header_size++] = frame->seq;
+	if(h->channels != NULL && frame->type == UART_COBS_TYPE_DATA)
+		header[header_size++] = frame->channel;
+	/* Encode header and segments, the encoder feeds the CRC unit in
+	 * the same pass */
+	length += header_size;
+	if(h->crc != UART_COBS_CRC_NONE)
+		length += UART_COBS_CRC_SIZE;
+	framer_encoder_init(&encoder, framer, output, size, start, length);
+	if(h->crc != UART_COBS_CRC_NONE)
+	{
+		uart_cobs_crc_begin(h, &crc);
+		framer_encoder_hook(&encoder, uart_cobs_tx_crc_hook, &crc);
+	}
+	if(header_size != 0)
+		framer_encoder_feed(&encoder, header, header_size);
+	for(size_t i = 0; i < count; i++)
+		framer_encoder_feed(&encoder, segments[i].data, segments[i].size);
+	if(h->crc != UART_COBS_CRC_NONE)
+	{
+		crc_value = crc_freertos_end(&crc);
+		framer_encoder_hook(&encoder, NULL, NULL);
+		framer_encoder_feed(&encoder, (const uint8_t *) &crc_value,
+			UART_COBS_CRC_SIZE);
+	}
+	length = framer_encoder_finish(&encoder);
+	h->stats.tx_bytes += length;
+	/* Payload is copied out, producer may reuse it */
+	if(frame->done)
+		frame->done(frame->arg, frame->data);
+	return length;
+}
+
+/* Create lanes and window */
+static void uart_cobs_tx_init(uart_cobs_service_t* h, struct uart_cobs_tx* tx)
+{
+	uart_cobs_arena_t* arena = uart_cobs_tx_arena(h);
+	/* Pending semaphore counts frames of every lane and a spare count
+	 * of RX task, it exists before producers see lanes */
+	h->tx_pending = uart_cobs_counting_create(arena,
+		UART_COBS_TX_LANES*h->queue_depth + 1);
+	if(uart_cobs_typed(h))
+		h->tx_event = uart_cobs_binary_create(arena);
+	for(size_t lane = 0; lane < UART_COBS_TX_LANES; lane++)
+		h->input_queue[lane] = uart_cobs_queue_create(arena, h->queue_depth,
+			sizeof(uart_cobs_tx_frame_t));
+	/* Data frame handler, first credit frame is due right away */
+	memset(tx, 0, sizeof(*tx));
+	tx->framer = uart_cobs_framer(h);
+	if(h->reliable)
+	{
+		uart_cobs_tx_window_create(h, tx);
+		/* First reset goes out right away */
+		h->tx_synced = 0;
+		tx->reset_tick = xTaskGetTickCount() - uart_cobs_retransmit_timeout(h);
 	}
+	h->tx_sent = 0;
+	h->rx_advertised = 0;
+	h->credit_tick = xTaskGetTickCount() - uart_cobs_credit_period(h);
+	tx->stats_tick = xTaskGetTickCount();
+	if(h->baud_max != 0)
+		h->baud_done = uart_cobs_binary_create(arena);
+}
+
+/* Encode frame at head of ring and start DMA if idle, ring has room
+ * for the largest frame */
+static void uart_cobs_tx_ring_put(uart_cobs_service_t* h,
+	struct uart_cobs_tx_ring* ring, const framer_t* framer,
+	const uart_cobs_tx_frame_t* frame)
+{
+	size_t head = uart_cobs_tx_encode(h, framer, frame, ring->buffer,
+		ring->size, ring->head);
+	/* New head wraps like the frame */
+	head += ring->head;
+	if(head >= ring->size)
+		head -= ring->size;
+	taskENTER_CRITICAL();
+	ring->head = head;
+	uart_cobs_tx_ring_kick(ring);
+	taskEXIT_CRITICAL();
 }
 
 void uart_cobs_service_tx_task(void const * argument)
 {
 	uart_cobs_service_t* h = (uart_cobs_service_t *) argument;
-	h->input_queue = xQueueCreate(h->queue_depth, sizeof(uart_cobs_frame_t));
-	/* Data frame handler */
-	uart_cobs_frame_t frame = {.data = NULL, .size = 0};
-	/* Buffer for COBS */
-	size_t cobs_buffer_size = h->max_frame_size + h->max_frame_size/254 + 2;
-	uint8_t *buf = pvPortMalloc(cobs_buffer_size);
-	if(!buf) Error_Handler();
+	uart_cobs_arena_t* arena = uart_cobs_tx_arena(h);
+	struct uart_cobs_tx tx;
+	uart_cobs_tx_init(h, &tx);
+	const uart_cobs_tx_frame_t* out = NULL;
+	/* Buffer for encoded frame or burst of frames */
+	const framer_t* framer = tx.framer;
+	size_t payload_size = uart_cobs_payload_size(h);
+	size_t cobs_buffer_size = framer->max_encoded_size(payload_size);
+	size_t tx_buffer_size = cobs_buffer_size;
+	if(h->tx_burst_size > tx_buffer_size)
+		tx_buffer_size = h->tx_burst_size;
+	uint8_t *buf = NULL;
+	struct uart_cobs_tx_ring* ring = NULL;
+	/* DMA mode without ring has two buffers, next frame is encoded
+	 * into one while the other is sent */
+	uint8_t *pingpong = NULL;
+	uint8_t sending = 0;
+	uint8_t retries = 0;
+	if(h->mode == UART_COBS_DMA && h->tx_ring_size != 0)
+	{
+		ring = uart_cobs_tx_ring_create(h, cobs_buffer_size);
+		tx.ring = ring;
+	}
+	else if(h->mode == UART_COBS_DMA)
+	{
+		pingpong = uart_cobs_alloc(arena, 2*tx_buffer_size);
+		buf = pingpong;
+		uart_cobs_tx_take(h);
+	}
+	else
+	{
+		buf = uart_cobs_alloc(arena, tx_buffer_size);
+	}
+	if(h->crc != UART_COBS_CRC_NONE
+		&& crc_freertos_init() == CRC_FREERTOS_ERR) Error_Handler();
 	size_t size = 0;
+	TickType_t burst_start = 0;
+	TickType_t elapsed = 0;
 	while(1)
 	{
-		xQueueReceive(h->input_queue, &frame, portMAX_DELAY);
-		size = cobs_encode((uint8_t *) frame.data, frame.size, buf);
-		buf[size++] = 0;
+		/* Baud rate changes once frames before are out */
+		if(tx.baud_switch != 0)
+		{
+			if(ring)
+				while(ring->sending != 0)
+					xSemaphoreTake(ring->space, portMAX_DELAY);
+			else if(sending)
+			{
+				xSemaphoreTake(h->huart->tx_complete, portMAX_DELAY);
+				sending = 0;
+			}
+			uart_cobs_tx_baud_switch(h, &tx);
+		}
+		/* Ring stopped by failed DMA start goes on a tick later */
+		if(ring)
+			uart_cobs_tx_ring_retry(h, ring);
+		/* Frame held back waits for an event of RX task, otherwise
+		 * the next frame is taken from lanes */
+		out = uart_cobs_tx_pick(h, &tx, cobs_buffer_size);
+		if(out == NULL)
+		{
+			if(tx.carry)
+				xSemaphoreTake(h->tx_event, uart_cobs_tx_timeout(h, &tx));
+			else
+				tx.carry = (uart_cobs_tx_next(h, &tx.frame,
+					uart_cobs_tx_timeout(h, &tx)) == pdTRUE);
+			continue;
+		}
+		if(ring)
+		{
+			while(uart_cobs_tx_ring_free(ring) < cobs_buffer_size)
+				if(xSemaphoreTake(ring->space, 1) == pdFALSE)
+					uart_cobs_tx_ring_retry(h, ring);
+			uart_cobs_tx_ring_put(h, ring, framer, out);
+			continue;
+		}
+		size = uart_cobs_tx_encode(h, framer, out, buf, 0, 0);
+		/* Frames queued up to burst delay after the first one are
+		 * encoded behind it and sent in one transfer */
+		if(h->tx_burst_size != 0)
+		{
+			burst_start = xTaskGetTickCount();
+			while(1)
+			{
+				out = uart_cobs_tx_pick(h, &tx, tx_buffer_size - size);
+				if(out != NULL)
+				{
+					size += uart_cobs_tx_encode(h, framer, out, &buf[size], 0, 0);
+					continue;
+				}
+				if(tx.carry)
+					break;
+				elapsed = xTaskGetTickCount() - burst_start;
+				tx.carry = (uart_cobs_tx_next(h, &tx.frame,
+					(elapsed < h->tx_burst_delay) ? h->tx_burst_delay - elapsed : 0)
+					== pdTRUE);
+				if(!tx.carry)
+					break;
+			}
+		}
 		switch(h->mode)
 		{
 		case UART_COBS_POLLING:
-			uart_freertos_tx(h->huart, buf, size,
-				portMAX_DELAY, HAL_MAX_DELAY);
+			if(uart_freertos_tx(h->huart, buf, size,
+				portMAX_DELAY, HAL_MAX_DELAY) != UART_FREERTOS_OK)
+				h->stats.tx_errors++;
 			break;
 		case UART_COBS_INTERRUPT:
-			uart_freertos_tx_it(h->huart, buf, size,
-				portMAX_DELAY, portMAX_DELAY);
+			if(uart_freertos_tx_it(h->huart, buf, size,
+				portMAX_DELAY, portMAX_DELAY) != UART_FREERTOS_OK)
+				h->stats.tx_errors++;
 			break;
 		case UART_COBS_DMA:
-			uart_freertos_tx_dma(h->huart, buf, size,
-				portMAX_DELAY, portMAX_DELAY);
+			/* Wait for the other buffer, then swap. Transfer that does
+			 * not start is retried a tick later, then dropped */
+			if(sending)
+				xSemaphoreTake(h->huart->tx_complete, portMAX_DELAY);
+			for(retries = 0; ; retries++)
+			{
+				sending = (uart_freertos_tx_dma_start(h->huart, buf, size)
+					== UART_FREERTOS_OK);
+				if(sending || retries + 1 >= UART_COBS_TX_RETRIES)
+					break;
+				vTaskDelay(1);
+			}
+			if(!sending)
+				h->stats.tx_errors++;
+			buf = (buf == pingpong) ? &pingpong[tx_buffer_size] : pingpong;
 			break;
 		default:
 			break;
@@ -140,6 +2130,103 @@ void uart_cobs_service_tx_task(void const * argument)
 	}
 }
 
+/* DMA complete or IDLE in single task mode */
+static void uart_cobs_rx_complete(void* arg,
+	BaseType_t* pxHigherPriorityTaskWoken)
+{
+	struct uart_cobs_rx* rx = (struct uart_cobs_rx *) arg;
+	rx->ready = 1;
+	vTaskNotifyGiveFromISR(rx->task, pxHigherPriorityTaskWoken);
+}
+
+/* Start RX DMA of single task mode, pdFALSE if it failed to start.
+ * Failed start is undone, IDLE interrupt included, for another try */
+static BaseType_t uart_cobs_rx_dma_start(uart_cobs_service_t* h,
+	struct uart_cobs_rx* rx)
+{
+	if(uart_freertos_rx_dma_start(h->huart, rx->buf, rx->space)
+		== UART_FREERTOS_OK)
+		return pdTRUE;
+	(void) uart_freertos_rx_dma_stop(h->huart, rx->space);
+	rx->ready = 0;
+	return pdFALSE;
+}
+
+/* Single task mode in DMA mode, RX and TX are driven from one loop.
+ * RX DMA, TX ring DMA and producers notify the task, it decodes what
+ * was received, fills the ring and waits for the next notification.
+ * Frames go out through the TX ring, burst settings do not apply. */
+void uart_cobs_service_task(void const * argument)
+{
+	uart_cobs_service_t* h = (uart_cobs_service_t *) argument;
+	struct uart_cobs_rx rx;
+	struct uart_cobs_tx tx;
+	struct uart_cobs_tx_ring* ring = NULL;
+	const uart_cobs_tx_frame_t* out = NULL;
+	size_t cobs_buffer_size = 0;
+	size_t size = 0;
+	BaseType_t rx_running = pdFALSE;
+	TickType_t timeout = 0;
+	if(h->mode != UART_COBS_DMA) Error_Handler();
+	h->task = xTaskGetCurrentTaskHandle();
+	uart_cobs_tx_init(h, &tx);
+	uart_cobs_rx_init(h, &rx);
+	cobs_buffer_size = tx.framer->max_encoded_size(uart_cobs_payload_size(h));
+	ring = uart_cobs_tx_ring_create(h, cobs_buffer_size);
+	tx.ring = ring;
+	/* Take RX of UART for good, DMA is restarted right after it stops */
+	rx.task = h->task;
+	xSemaphoreTake(h->huart->rx_mutex, portMAX_DELAY);
+	uart_freertos_set_rx_callback(h->huart, uart_cobs_rx_complete, &rx);
+	uart_cobs_rx_buffer(&rx);
+	rx_running = uart_cobs_rx_dma_start(h, &rx);
+	while(1)
+	{
+		/* Baud rate changes once frames before are out */
+		if(tx.baud_switch != 0)
+		{
+			while(ring->sending != 0 || uart_cobs_tx_ring_stalled(ring))
+			{
+				uart_cobs_tx_ring_retry(h, ring);
+				ulTaskNotifyTake(pdTRUE, (ring->sending != 0) ? portMAX_DELAY : 1);
+			}
+			uart_cobs_tx_baud_switch(h, &tx);
+		}
+		if(rx.ready && rx_running)
+		{
+			rx.ready = 0;
+			size = uart_freertos_rx_dma_stop(h->huart, rx.space);
+			uart_cobs_rx_decode(h, &rx, size);
+			uart_cobs_rx_buffer(&rx);
+			rx_running = pdFALSE;
+		}
+		/* RX DMA failed to start goes on a tick later */
+		if(!rx_running)
+			rx_running = uart_cobs_rx_dma_start(h, &rx);
+		/* Ring stopped by failed DMA start goes on a tick later */
+		uart_cobs_tx_ring_retry(h, ring);
+		/* Fill ring while it has room for the largest frame */
+		while(uart_cobs_tx_ring_free(ring) >= cobs_buffer_size)
+		{
+			out = uart_cobs_tx_pick(h, &tx, cobs_buffer_size);
+			if(out != NULL)
+				uart_cobs_tx_ring_put(h, ring, tx.framer, out);
+			else if(!tx.carry)
+			{
+				tx.carry = (uart_cobs_tx_next(h, &tx.frame, 0) == pdTRUE);
+				if(!tx.carry && uxSemaphoreGetCount(h->tx_pending) == 0)
+					break;
+			}
+			else
+				break;
+		}
+		timeout = uart_cobs_tx_timeout(h, &tx);
+		if(!rx_running)
+			timeout = 1;
+		ulTaskNotifyTake(pdTRUE, timeout);
+	}
+}
+
 osThreadId uart_cobs_service_rx_create(char *name, osPriority priority,
 	uint32_t instances, uint32_t stack_size, uart_cobs_service_t* h)
 {
@@ -171,3 +2258,69 @@ osThreadId uart_cobs_service_tx_create(char *name, osPriority priority,
 
 	return osThreadCreate(&thread, (void *) h);
 }
+
+/* Tasks of static service, control blocks and stacks are taken from
+ * its storage */
+osThreadId uart_cobs_service_rx_create_static(char *name, osPriority priority,
+	uart_cobs_service_t* h)
+{
+	osThreadAttr_t attributes = {
+		.name		= name,
+		.cb_mem		= &h->storage->rx_task,
+		.cb_size	= sizeof(h->storage->rx_task),
+		.stack_mem	= h->storage->rx_stack,
+		.stack_size	= h->storage->rx_stack_size,
+		.priority	= priority
+	};
+
+	return osThreadNew((osThreadFunc_t) uart_cobs_service_rx_task, (void *) h,
+		&attributes);
+}
+
+osThreadId uart_cobs_service_tx_create_static(char *name, osPriority priority,
+	uart_cobs_service_t* h)
+{
+	osThreadAttr_t attributes = {
+		.name		= name,
+		.cb_mem		= &h->storage->tx_task,
+		.cb_size	= sizeof(h->storage->tx_task),
+		.stack_mem	= h->storage->tx_stack,
+		.stack_size	= h->storage->tx_stack_size,
+		.priority	= priority
+	};
+
+	return osThreadNew((osThreadFunc_t) uart_cobs_service_tx_task, (void *) h,
+		&attributes);
+}
+
+/* Single task of both directions */
+osThreadId uart_cobs_service_create(char *name, osPriority priority,
+	uint32_t stack_size, uart_cobs_service_t* h)
+{
+	osThreadAttr_t attributes = {
+		.name		= name,
+		.stack_size	= stack_size,
+		.priority	= priority
+	};
+
+	return osThreadNew((osThreadFunc_t) uart_cobs_service_task, (void *) h,
+		&attributes);
+}
+
+/* Single task of static service, takes control block and stack of RX
+ * task */
+osThreadId uart_cobs_service_create_static(char *name, osPriority priority,
+	uart_cobs_service_t* h)
+{
+	osThreadAttr_t attributes = {
+		.name		= name,
+		.cb_mem		= &h->storage->rx_task,
+		.cb_size	= sizeof(h->storage->rx_task),
+		.stack_mem	= h->storage->rx_stack,
+		.stack_size	= h->storage->rx_stack_size,
+		.priority	= priority
+	};
+
+	return osThreadNew((osThreadFunc_t) uart_cobs_service_task, (void *) h,
+		&attributes);
+}
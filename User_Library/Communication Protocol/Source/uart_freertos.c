@@ -2,6 +2,7 @@
 /* FreeRTOS */
 #include "stm32f1xx_hal.h"
 #include "FreeRTOS.h"
+#include "task.h"
 #include "semphr.h"
 #include "stm32f1xx_hal_uart.h"
 
@@ -90,6 +91,10 @@ uart_freertos_status uart_freertos_init(uart_freertos_t* uart_rtos)
 	uart_rtos->rx_mutex = xSemaphoreCreateMutex();
 	uart_rtos->tx_complete = xSemaphoreCreateBinary();
 	uart_rtos->rx_complete = xSemaphoreCreateBinary();
+	uart_rtos->tx_callback = NULL;
+	uart_rtos->tx_callback_arg = NULL;
+	uart_rtos->rx_callback = NULL;
+	uart_rtos->rx_callback_arg = NULL;
 
 	/* register spi_freertos_base into list */
 	uart_rtos_list_append(uart_rtos);
@@ -265,6 +270,96 @@ uart_freertos_status uart_freertos_tx_dma (uart_freertos_t* uart, const void* da
 	return rtn;
 }
 
+/* Start transmit using DMA, completion is reported to tx_callback */
+uart_freertos_status uart_freertos_tx_dma_start (uart_freertos_t* uart, const void* data, size_t data_size)
+{
+	return parse_hal_status(HAL_UART_Transmit_DMA(uart->huart, (void*) data, data_size));
+}
+
+/* Replace giving of tx_complete by callback, NULL restores semaphore */
+void uart_freertos_set_tx_callback(uart_freertos_t* uart,
+		void (*callback)(void* arg, BaseType_t* pxHigherPriorityTaskWoken), void* arg)
+{
+	taskENTER_CRITICAL();
+	uart->tx_callback = callback;
+	uart->tx_callback_arg = arg;
+	taskEXIT_CRITICAL();
+}
+
+/* Start receive using DMA with IDLE interrupt without waiting. Caller
+ * must own RX of UART, DMA complete and IDLE are reported to rx_callback */
+uart_freertos_status uart_freertos_rx_dma_start (uart_freertos_t* uart, const void* data, size_t data_size)
+{
+	SET_BIT(uart->huart->Instance->CR1,USART_CR1_IDLEIE);
+	return parse_hal_status(HAL_UART_Receive_DMA(uart->huart, (void*) data, data_size));
+}
+
+/* Stop receive started by uart_freertos_rx_dma_start, returns number
+ * of bytes received */
+size_t uart_freertos_rx_dma_stop (uart_freertos_t* uart, size_t data_size)
+{
+	HAL_UART_AbortReceive_IT(uart->huart);
+	CLEAR_BIT(uart->huart->Instance->CR1,USART_CR1_IDLEIE);
+	return data_size - __HAL_DMA_GET_COUNTER(uart->huart->hdmarx);
+}
+
+/* Replace giving of rx_complete by callback, NULL restores semaphore */
+void uart_freertos_set_rx_callback(uart_freertos_t* uart,
+		void (*callback)(void* arg, BaseType_t* pxHigherPriorityTaskWoken), void* arg)
+{
+	taskENTER_CRITICAL();
+	uart->rx_callback = callback;
+	uart->rx_callback_arg = arg;
+	taskEXIT_CRITICAL();
+}
+
+/* Clock of USART, USART1 runs on APB2, the others on APB1 */
+static uint32_t uart_freertos_pclk (UART_HandleTypeDef* huart)
+{
+	if(huart->Instance == USART1)
+		return HAL_RCC_GetPCLK2Freq();
+	return HAL_RCC_GetPCLK1Freq();
+}
+
+/* UART_FREERTOS_OK if USART can run at "baud". BRR is computed as HAL
+ * does at init, the rate it makes is off by 2 % at most */
+uart_freertos_status uart_freertos_check_baud (uart_freertos_t* uart, uint32_t baud)
+{
+	uint32_t pclk = uart_freertos_pclk(uart->huart);
+	uint32_t made = 0;
+
+	/* Divider is 1 at least and fits 12 bits of mantissa */
+	if(baud == 0 || baud > pclk/16 || pclk/16/baud > 0x0FFF)
+		return UART_FREERTOS_ERR;
+	made = pclk / UART_BRR_SAMPLING16(pclk, baud);
+	if(50*((made > baud) ? made - baud : baud - made) > baud)
+		return UART_FREERTOS_ERR;
+	return UART_FREERTOS_OK;
+}
+
+/* Change baud rate once the last byte is out, nothing changes if USART
+ * can not run at "baud" */
+uart_freertos_status uart_freertos_set_baud (uart_freertos_t* uart, uint32_t baud)
+{
+	UART_HandleTypeDef* huart = uart->huart;
+	uint32_t pclk = uart_freertos_pclk(huart);
+
+	if(uart_freertos_check_baud(uart, baud) != UART_FREERTOS_OK)
+		return UART_FREERTOS_ERR;
+
+	while(__HAL_UART_GET_FLAG(huart, UART_FLAG_TC) == RESET)
+		taskYIELD();
+
+	taskENTER_CRITICAL();
+	__HAL_UART_DISABLE(huart);
+	huart->Init.BaudRate = baud;
+	huart->Instance->BRR = UART_BRR_SAMPLING16(pclk, baud);
+	__HAL_UART_ENABLE(huart);
+	taskEXIT_CRITICAL();
+
+	return UART_FREERTOS_OK;
+}
+
 /* Recieve data through UART whithout interupts */
 uart_freertos_status_t uart_freertos_rx_dma (uart_freertos_t* uart, const void* data, size_t data_size,
 		TickType_t mutex_timeout, TickType_t transfer_timeout)
@@ -372,7 +467,11 @@ void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
 	BaseType_t xHigherPriorityTaskWoken = pdFALSE;
 	struct uart_rtos_list *item = uart_rtos_list_find_item(huart);
 	if(item == NULL) return;
-	xSemaphoreGiveFromISR(item->uart_rtos->rx_complete,	&xHigherPriorityTaskWoken);
+	if(item->uart_rtos->rx_callback != NULL)
+		item->uart_rtos->rx_callback(item->uart_rtos->rx_callback_arg,
+			&xHigherPriorityTaskWoken);
+	else
+		xSemaphoreGiveFromISR(item->uart_rtos->rx_complete,	&xHigherPriorityTaskWoken);
 	portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 }
 
@@ -382,7 +481,11 @@ void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
 	BaseType_t xHigherPriorityTaskWoken = pdFALSE;
 	struct uart_rtos_list *item = uart_rtos_list_find_item(huart);
 	if(item == NULL) return;
-	xSemaphoreGiveFromISR(item->uart_rtos->tx_complete,	&xHigherPriorityTaskWoken);
+	if(item->uart_rtos->tx_callback != NULL)
+		item->uart_rtos->tx_callback(item->uart_rtos->tx_callback_arg,
+			&xHigherPriorityTaskWoken);
+	else
+		xSemaphoreGiveFromISR(item->uart_rtos->tx_complete,	&xHigherPriorityTaskWoken);
 	portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 }
 
@@ -392,7 +495,11 @@ void uart_freertos_rx_idle_callback(UART_HandleTypeDef *huart)
 	struct uart_rtos_list *item = uart_rtos_list_find_item(huart);
 	if(item == NULL) return;
 	READ_REG(huart->Instance->DR);
-	xSemaphoreGiveFromISR(item->uart_rtos->rx_complete,	&xHigherPriorityTaskWoken);
+	if(item->uart_rtos->rx_callback != NULL)
+		item->uart_rtos->rx_callback(item->uart_rtos->rx_callback_arg,
+			&xHigherPriorityTaskWoken);
+	else
+		xSemaphoreGiveFromISR(item->uart_rtos->rx_complete,	&xHigherPriorityTaskWoken);
 	portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 }
 
@@ -0,0 +1,207 @@
+/* Throughput of the cobs.c codecs over payload classes, in payload
+ * bytes per cycle of the time stamp counter (per nanosecond where
+ * there is none). The COBS word kernels are compared against the
+ * byte at a time reference of cobs_ref.c they replaced.
+ *
+ * usage: cobs_bench [megabytes]
+ */
+
+#define _POSIX_C_SOURCE	199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_UNIT		"cycle"
+#else
+#define BENCH_UNIT		"ns"
+#endif
+
+#include "cobs.h"
+#include "cobs_ref.h"
+
+#define BENCH_SIZE		4096
+#define BENCH_MEGABYTES	64UL
+#define BENCH_SEED		0x12345678UL
+
+typedef enum
+{
+	BENCH_RANDOM,		// uniformly random bytes
+	BENCH_ZERO,			// all zero
+	BENCH_NONZERO,		// no zero byte at all
+	BENCH_RUNS,			// 254 nonzero bytes and a zero
+	BENCH_WORST,		// no zero, frames of 254*k-1 and 254*k+1 bytes
+	BENCH_CLASSES
+} bench_class_t;
+
+static const char *const class_name[BENCH_CLASSES] =
+{
+	"random", "all-zero", "no-zero", "254-runs", "worst-size"
+};
+
+static const char *const codec_name[] = { "COBS", "COBS/R", "COBS/ZPE" };
+
+/* Kernel under test, reference or cobs.c */
+typedef struct
+{
+	size_t (*encode)(cobs_codec_t codec, const uint8_t *input,
+		size_t length, uint8_t *output);
+	size_t (*decode)(cobs_codec_t codec, const uint8_t *input,
+		size_t length, uint8_t *output);
+} bench_kernel_t;
+
+static const bench_kernel_t kernel_ref =
+{
+	cobs_ref_codec_encode, cobs_ref_codec_decode
+};
+
+static const bench_kernel_t kernel_cobs =
+{
+	cobs_codec_encode, cobs_codec_decode
+};
+
+/* Frame sizes of a class, the last one is 0 */
+static const size_t class_sizes[BENCH_CLASSES][3] =
+{
+	{ BENCH_SIZE, 0 },
+	{ BENCH_SIZE, 0 },
+	{ BENCH_SIZE, 0 },
+	{ BENCH_SIZE, 0 },
+	{ 254 * 4 - 1, 254 * 4 + 1, 0 }
+};
+
+static uint8_t payload[BENCH_SIZE];
+static uint8_t encoded[2][COBS_ZPE_MAX_ENCODED_SIZE(BENCH_SIZE)];
+static uint8_t decoded[BENCH_SIZE];
+static volatile size_t sink;
+
+static uint64_t bench_clock(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000000ULL + (uint64_t) now.tv_nsec;
+#endif
+}
+
+static void bench_payload(bench_class_t class)
+{
+	uint32_t state = BENCH_SEED;
+	size_t i;
+
+	for(i = 0; i < BENCH_SIZE; i++)
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		switch(class)
+		{
+		case BENCH_RANDOM:
+			payload[i] = (uint8_t) state;
+			break;
+		case BENCH_ZERO:
+			payload[i] = 0;
+			break;
+		case BENCH_RUNS:
+			payload[i] = (i % 255 == 254) ? 0 : (uint8_t) (state % 255 + 1);
+			break;
+		default:
+			payload[i] = (uint8_t) (state % 255 + 1);
+			break;
+		}
+	}
+}
+
+/* Payload bytes per unit of encoding "total" bytes of "class" */
+static double bench_encode(const bench_kernel_t *kernel, cobs_codec_t codec,
+	bench_class_t class, unsigned long total)
+{
+	const size_t *sizes = class_sizes[class];
+	unsigned long bytes = 0;
+	uint64_t start;
+	size_t i = 0;
+
+	start = bench_clock();
+	while(bytes < total)
+	{
+		sink += kernel->encode(codec, payload, sizes[i], encoded[i]);
+		bytes += sizes[i++];
+		if(sizes[i] == 0)
+			i = 0;
+	}
+	return (double) bytes / (double) (bench_clock() - start);
+}
+
+static double bench_decode(const bench_kernel_t *kernel, cobs_codec_t codec,
+	bench_class_t class, unsigned long total)
+{
+	const size_t *sizes = class_sizes[class];
+	unsigned long bytes = 0;
+	size_t lengths[2];
+	uint64_t start;
+	size_t i;
+
+	for(i = 0; sizes[i] != 0; i++)
+		lengths[i] = cobs_codec_encode(codec, payload, sizes[i], encoded[i]);
+
+	i = 0;
+	start = bench_clock();
+	while(bytes < total)
+	{
+		sink += kernel->decode(codec, encoded[i], lengths[i], decoded);
+		bytes += sizes[i++];
+		if(sizes[i] == 0)
+			i = 0;
+	}
+	return (double) bytes / (double) (bench_clock() - start);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long total = BENCH_MEGABYTES << 20;
+	bench_class_t class;
+	cobs_codec_t codec;
+	double encode[2];
+	double decode[2];
+
+	if(argc > 1)
+		total = strtoul(argv[1], NULL, 0) << 20;
+
+	printf("%-10s %-9s %15s %15s\n", "payload", "codec",
+		"encode B/" BENCH_UNIT, "decode B/" BENCH_UNIT);
+	for(class = BENCH_RANDOM; class < BENCH_CLASSES; class++)
+	{
+		bench_payload(class);
+		for(codec = COBS_CODEC_COBS; codec <= COBS_CODEC_ZPE; codec++)
+		{
+			printf("%-10s %-9s %15.3f %15.3f\n", class_name[class],
+				codec_name[codec],
+				bench_encode(&kernel_cobs, codec, class, total),
+				bench_decode(&kernel_cobs, codec, class, total));
+		}
+	}
+
+	printf("\nCOBS word kernels against the byte at a time reference\n");
+	printf("%-10s %15s %15s %8s %15s %15s %8s\n", "payload",
+		"ref enc B/" BENCH_UNIT, "encode B/" BENCH_UNIT, "speedup",
+		"ref dec B/" BENCH_UNIT, "decode B/" BENCH_UNIT, "speedup");
+	for(class = BENCH_RANDOM; class <= BENCH_NONZERO; class++)
+	{
+		bench_payload(class);
+		encode[0] = bench_encode(&kernel_ref, COBS_CODEC_COBS, class, total);
+		encode[1] = bench_encode(&kernel_cobs, COBS_CODEC_COBS, class, total);
+		decode[0] = bench_decode(&kernel_ref, COBS_CODEC_COBS, class, total);
+		decode[1] = bench_decode(&kernel_cobs, COBS_CODEC_COBS, class, total);
+		printf("%-10s %15.3f %15.3f %7.2fx %15.3f %15.3f %7.2fx\n",
+			class_name[class], encode[0], encode[1], encode[1] / encode[0],
+			decode[0], decode[1], decode[1] / decode[0]);
+	}
+
+	return 0;
+}
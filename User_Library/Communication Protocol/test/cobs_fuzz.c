@@ -0,0 +1,499 @@
+/* Deterministic differential fuzzer of cobs.c against the byte at a
+ * time reference model of cobs_ref.c. Every payload goes through the
+ * one-shot, scatter, piecewise and ring encoders and the one-shot,
+ * in-place and streaming decoders of each codec, all of them have to
+ * agree with the reference and stay within the worst-case size.
+ *
+ * usage: cobs_fuzz [iterations [seed]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cobs.h"
+#include "cobs_ref.h"
+
+#define FUZZ_ITERATIONS		20000UL
+#define FUZZ_SEED			0x12345678UL
+#define FUZZ_MAX			1200
+#define FUZZ_ENCODED_MAX	(COBS_ZPE_MAX_ENCODED_SIZE(FUZZ_MAX) + 1)
+#define FUZZ_GUARD			16
+#define FUZZ_PATTERN		0xA5
+#define FUZZ_FRAMES			4
+#define FUZZ_STREAM_MAX		\
+	(FUZZ_FRAMES * (FUZZ_ENCODED_MAX + 4))
+
+static const char *const codec_name[] = { "COBS", "COBS/R", "COBS/ZPE" };
+
+static uint32_t rng_state;
+static unsigned long iteration;
+static cobs_codec_t codec;
+static size_t length;
+
+static uint8_t payload[FUZZ_MAX + 1];
+static uint8_t expect[FUZZ_ENCODED_MAX];
+static size_t expect_length;
+static uint8_t actual[FUZZ_ENCODED_MAX + FUZZ_GUARD];
+static uint8_t decoded[2 * FUZZ_ENCODED_MAX + FUZZ_GUARD];
+static uint8_t ring[FUZZ_ENCODED_MAX + 64];
+static uint8_t seen[2 * FUZZ_ENCODED_MAX];
+static size_t seen_length;
+
+/* xorshift32 */
+static uint32_t rng(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+static size_t rng_below(size_t limit)
+{
+	return limit ? rng() % limit : 0;
+}
+
+static void fail(const char *what)
+{
+	fprintf(stderr, "cobs_fuzz: %s: %s, %lu bytes, iteration %lu\n",
+		codec_name[codec], what, (unsigned long) length, iteration);
+	exit(1);
+}
+
+/* Payload lengths cluster around the block sizes of the codecs */
+static size_t fuzz_length(void)
+{
+	static const size_t edges[] = { 0, 1, 2, 222, 223, 224, 253, 254, 255,
+		446, 508, 509, FUZZ_MAX };
+
+	switch(rng() % 4)
+	{
+	case 0:
+		return rng_below(16);
+	case 1:
+		return edges[rng_below(sizeof(edges) / sizeof(edges[0]))];
+	default:
+		return rng_below(FUZZ_MAX + 1);
+	}
+}
+
+/* Random, all-zero, no-zero, long runs and zero pairs */
+static void fuzz_payload(void)
+{
+	size_t spacing;
+	size_t i;
+
+	length = fuzz_length();
+	switch(rng() % 6)
+	{
+	case 0:
+		for(i = 0; i < length; i++)
+			payload[i] = (uint8_t) rng();
+		break;
+	case 1:
+		memset(payload, 0, length);
+		break;
+	case 2:
+		for(i = 0; i < length; i++)
+			payload[i] = (uint8_t) (rng() % 255 + 1);
+		break;
+	case 3:
+		spacing = 221 + rng_below(36);
+		for(i = 0; i < length; i++)
+			payload[i] = (i % spacing == spacing - 1) ? 0 : (uint8_t) (i | 1);
+		break;
+	case 4:
+		for(i = 0; i < length; i++)
+			payload[i] = (rng() % 4 == 0) ? (uint8_t) rng() : 0;
+		break;
+	default:
+		for(i = 0; i < length; i++)
+			payload[i] = (rng() % 8) ? (uint8_t) (rng() | 1) : 0;
+		break;
+	}
+}
+
+/* Collects what the codec passes to its hook */
+static void fuzz_hook(void *arg, const uint8_t *data, size_t size)
+{
+	if(arg != seen || size == 0)
+		fail("hook called with bad arguments");
+	memcpy(&seen[seen_length], data, size);
+	seen_length += size;
+}
+
+static void check_hook(const uint8_t *data, size_t size, const char *what)
+{
+	if(seen_length != size || memcmp(seen, data, size) != 0)
+		fail(what);
+	seen_length = 0;
+}
+
+static void check_guard(const uint8_t *buffer, size_t size, const char *what)
+{
+	size_t i;
+
+	for(i = 0; i < size; i++)
+	{
+		if(buffer[i] != FUZZ_PATTERN)
+			fail(what);
+	}
+}
+
+static void check_encoded(const uint8_t *output, size_t size, const char *what)
+{
+	if(size != expect_length || memcmp(output, expect, size) != 0)
+		fail(what);
+}
+
+static void check_decoded(size_t size, const char *what)
+{
+	if(size != length || memcmp(decoded, payload, size) != 0)
+		fail(what);
+}
+
+/* Worst case sizes of cobs.h, delimiter included the COBS frames
+ * never exceed max + max/254 + 2
+ */
+static void fuzz_bound(void)
+{
+	size_t i;
+
+	if(expect_length > cobs_max_encoded_size(codec, length))
+		fail("cobs_max_encoded_size() exceeded");
+	if(codec == COBS_CODEC_ZPE)
+	{
+		if(expect_length > COBS_ZPE_MAX_ENCODED_SIZE(length))
+			fail("COBS_ZPE_MAX_ENCODED_SIZE exceeded");
+	}
+	else
+	{
+		if(expect_length > COBS_MAX_ENCODED_SIZE(length)
+			|| expect_length + 1 > length + length / 254 + 2)
+			fail("COBS_MAX_ENCODED_SIZE exceeded");
+	}
+	for(i = 0; i < expect_length; i++)
+	{
+		if(expect[i] == 0)
+			fail("zero byte in encoded frame");
+	}
+	if(codec == COBS_CODEC_COBS && memchr(payload, 0, length) == NULL
+		&& expect_length != COBS_MAX_ENCODED_SIZE(length))
+		fail("COBS_MAX_ENCODED_SIZE not reached by no-zero payload");
+}
+
+static void fuzz_encode(void)
+{
+	cobs_segment_t segments[8];
+	cobs_encoder_t encoder;
+	size_t limit = cobs_max_encoded_size(codec, length);
+	size_t count;
+	size_t offset;
+	size_t size;
+	size_t i;
+
+	/* One-shot */
+	memset(actual, FUZZ_PATTERN, sizeof(actual));
+	size = cobs_codec_encode(codec, payload, length, actual);
+	check_encoded(actual, size, "cobs_codec_encode() differs");
+	check_guard(&actual[limit], FUZZ_GUARD,
+		"cobs_codec_encode() wrote past the end");
+
+	/* Piecewise, blocks span the pieces, hook sees the payload */
+	memset(actual, FUZZ_PATTERN, sizeof(actual));
+	cobs_encoder_init(&encoder, codec, actual);
+	cobs_encoder_hook(&encoder, fuzz_hook, seen);
+	for(offset = 0; offset < length; offset += size)
+	{
+		size = 1 + rng_below(rng() % 2 ? 8 : length - offset);
+		if(size > length - offset)
+			size = length - offset;
+		cobs_encoder_feed(&encoder, &payload[offset], size);
+	}
+	size = cobs_encoder_finish(&encoder);
+	check_encoded(actual, size, "cobs_encoder_feed() differs");
+	check_hook(payload, length, "encoder hook differs");
+	check_guard(&actual[limit], FUZZ_GUARD,
+		"cobs_encoder_feed() wrote past the end");
+
+	/* Scatter-gather, COBS only */
+	if(codec == COBS_CODEC_COBS)
+	{
+		count = 1 + rng_below(sizeof(segments) / sizeof(segments[0]));
+		for(i = 0, offset = 0; i < count; i++)
+		{
+			size = (i == count - 1) ? length - offset
+				: rng_below(length - offset + 1);
+			segments[i].data = &payload[offset];
+			segments[i].size = size;
+			offset += size;
+		}
+		memset(actual, FUZZ_PATTERN, sizeof(actual));
+		size = cobs_encode_v(segments, count, actual);
+		check_encoded(actual, size, "cobs_encode_v() differs");
+		check_guard(&actual[limit], FUZZ_GUARD, "cobs_encode_v() wrote past the end");
+	}
+
+	/* Ring, frame wraps at a random offset. COBS/R writes the last byte
+	 * before moving it to the code, up to the worst case is written.
+	 */
+	size = limit + rng_below(sizeof(ring) - limit + 1);
+	offset = rng_below(size);
+	memset(ring, FUZZ_PATTERN, sizeof(ring));
+	cobs_encoder_init_ring(&encoder, codec, ring, size, offset);
+	for(i = 0; i < length; i += count)
+	{
+		count = 1 + rng_below(length - i);
+		cobs_encoder_feed(&encoder, &payload[i], count);
+	}
+	if(cobs_encoder_finish(&encoder) != expect_length)
+		fail("ring encoder length differs");
+	for(i = 0; i < size; i++)
+	{
+		if((i + size - offset) % size < expect_length)
+		{
+			if(ring[i] != expect[(i + size - offset) % size])
+				fail("ring encoder differs");
+		}
+		else if((i + size - offset) % size >= limit && ring[i] != FUZZ_PATTERN)
+			fail("ring encoder wrote outside the frame");
+	}
+	check_guard(&ring[size], sizeof(ring) - size,
+		"ring encoder wrote outside the frame");
+}
+
+static void fuzz_decode(void)
+{
+	size_t size;
+
+	memset(decoded, FUZZ_PATTERN, sizeof(decoded));
+	size = cobs_codec_decode(codec, expect, expect_length, decoded);
+	check_decoded(size, "cobs_codec_decode() differs");
+	check_guard(&decoded[size], FUZZ_GUARD,
+		"cobs_codec_decode() wrote past the end");
+
+	size = cobs_ref_codec_decode(codec, expect, expect_length, decoded);
+	check_decoded(size, "reference decode differs");
+
+	size = cobs_codec_decode_hook(codec, expect, expect_length, decoded,
+		fuzz_hook, seen);
+	check_decoded(size, "cobs_codec_decode_hook() differs");
+	check_hook(payload, length, "decoder hook differs");
+
+	if(codec == COBS_CODEC_COBS)
+	{
+		size = cobs_decode(expect, expect_length, decoded);
+		check_decoded(size, "cobs_decode() differs");
+	}
+
+	/* COBS and COBS/R decode in place */
+	if(codec != COBS_CODEC_ZPE)
+	{
+		memcpy(decoded, expect, expect_length);
+		size = cobs_codec_decode_hook(codec, decoded, expect_length, decoded,
+			fuzz_hook, seen);
+		check_decoded(size, "in-place decode differs");
+		check_hook(payload, length, "in-place decoder hook differs");
+	}
+}
+
+/* Offset of the code after the block of "code" */
+static size_t fuzz_next_code(uint8_t code)
+{
+	if(codec == COBS_CODEC_ZPE && code > COBS_ZPE_RUN)
+		return code - COBS_ZPE_PAIR + 1;
+	return code;
+}
+
+/* Zero is the delimiter, a 0x00 code byte is rejected by every codec.
+ * The original cobs_decode() unstuffed it as an empty block.
+ */
+static void fuzz_zero_code(void)
+{
+	static const uint8_t lone[] = { 0x00 };
+	static const uint8_t inner[] = { 0x02, 'a', 0x00, 0x01 };
+	size_t code_index = 0;
+	size_t codes = 0;
+	size_t target;
+
+	if(cobs_codec_decode(codec, lone, sizeof(lone), decoded) != 0
+		|| cobs_codec_decode(codec, inner, sizeof(inner), decoded) != 0)
+		fail("zero code byte accepted");
+	if(codec == COBS_CODEC_COBS
+		&& cobs_ref_decode(inner, sizeof(inner), decoded) != 3)
+		fail("reference no longer decodes zero code byte");
+
+	/* Replace a random code byte of the valid frame */
+	while(code_index < expect_length)
+	{
+		codes++;
+		code_index += fuzz_next_code(expect[code_index]);
+	}
+	target = rng_below(codes);
+	memcpy(actual, expect, expect_length);
+	for(code_index = 0; target != 0; target--)
+		code_index += fuzz_next_code(actual[code_index]);
+	if(code_index < expect_length)
+	{
+		actual[code_index] = 0;
+		if(cobs_codec_decode(codec, actual, expect_length, decoded) != 0)
+			fail("zero code byte in frame accepted");
+	}
+}
+
+/* Malformed frames must not overrun, the one-shot and streaming
+ * decoders have to agree on them.
+ */
+static void fuzz_garbage(void)
+{
+	cobs_decoder_t decoder;
+	cobs_decoder_status_t status;
+	size_t consumed;
+	size_t limit;
+	size_t size;
+	size_t i;
+
+	length = 1 + rng_below(FUZZ_MAX);
+	for(i = 0; i < length; i++)
+	{
+		payload[i] = (uint8_t) (rng() % 255 + 1);
+	}
+	if(rng() % 2)
+	{
+		/* Short blocks, bias codes towards a valid chain */
+		for(i = 0; i < length; i += payload[i])
+			payload[i] = (uint8_t) (rng() % 16 + 1);
+	}
+
+	/* Up to two zeros per byte for COBS/ZPE */
+	limit = (codec == COBS_CODEC_ZPE) ? 2 * length : length;
+	memset(decoded, FUZZ_PATTERN, sizeof(decoded));
+	size = cobs_codec_decode(codec, payload, length, decoded);
+	if(size > limit)
+		fail("malformed frame decoded too long");
+	check_guard(&decoded[limit], FUZZ_GUARD,
+		"malformed frame decode wrote past the end");
+	memcpy(actual, decoded, size);
+
+	/* Apart from zero codes the original cobs_decode() agrees */
+	if(codec == COBS_CODEC_COBS
+		&& (cobs_ref_decode(payload, length, decoded) != size
+		|| memcmp(decoded, actual, size) != 0))
+		fail("cobs_decode() and reference differ on malformed frame");
+
+	payload[length] = 0;
+	cobs_decoder_init(&decoder, codec, decoded, sizeof(decoded));
+	status = cobs_decoder_feed(&decoder, payload, length + 1, &consumed);
+	if(consumed != length + 1)
+		fail("streaming decoder stopped early on malformed frame");
+	if(size != 0)
+	{
+		if(status != COBS_DECODER_FRAME || decoder.length != size
+			|| memcmp(decoded, actual, size) != 0)
+			fail("streaming and one-shot decode of malformed frame differ");
+	}
+	else if(status == COBS_DECODER_FRAME && decoder.length != 0)
+		fail("streaming decoder accepted malformed frame");
+}
+
+/* Several frames with padding delimiters, fed in random chunks to a
+ * decoder whose output is sometimes one byte short.
+ */
+static void fuzz_stream(void)
+{
+	static uint8_t stream[FUZZ_STREAM_MAX];
+	static uint8_t frames[FUZZ_FRAMES][FUZZ_MAX];
+	size_t lengths[FUZZ_FRAMES];
+	size_t sizes[FUZZ_FRAMES];
+	size_t count = 1 + rng_below(FUZZ_FRAMES);
+	size_t stream_length = 0;
+	size_t frame = 0;
+	size_t offset;
+	size_t chunk;
+	size_t consumed;
+	cobs_decoder_t decoder;
+	cobs_decoder_status_t status;
+	size_t i;
+
+	for(i = 0; i < count; i++)
+	{
+		while(rng() % 3 == 0)
+			stream[stream_length++] = 0;
+		fuzz_payload();
+		if(length > FUZZ_MAX / FUZZ_FRAMES)
+			length = FUZZ_MAX / FUZZ_FRAMES;
+		memcpy(frames[i], payload, length);
+		lengths[i] = length;
+		sizes[i] = length;
+		if(length != 0 && rng() % 8 == 0)
+			sizes[i] = length - 1;
+		stream_length += cobs_ref_codec_encode(codec, payload, length,
+			&stream[stream_length]);
+		stream[stream_length++] = 0;
+	}
+
+	cobs_decoder_init(&decoder, codec, decoded, sizes[0]);
+	for(offset = 0; offset < stream_length; offset += chunk)
+	{
+		chunk = 1 + rng_below(rng() % 2 ? 16 : stream_length - offset);
+		if(chunk > stream_length - offset)
+			chunk = stream_length - offset;
+		for(i = 0; i < chunk; i += consumed)
+		{
+			status = cobs_decoder_feed(&decoder, &stream[offset + i],
+				chunk - i, &consumed);
+			if(status == COBS_DECODER_MORE)
+				continue;
+			if(frame >= count)
+				fail("streaming decoder found extra frame");
+			length = lengths[frame];
+			if(sizes[frame] < length)
+			{
+				if(status != COBS_DECODER_ERROR)
+					fail("streaming decoder overran short output");
+			}
+			else if(status != COBS_DECODER_FRAME || decoder.length != length
+				|| memcmp(decoded, frames[frame], length) != 0)
+				fail("streaming decoder differs");
+			frame++;
+			cobs_decoder_init(&decoder, codec, decoded,
+				frame < count ? sizes[frame] : sizeof(decoded));
+		}
+	}
+	if(frame != count)
+		fail("streaming decoder lost a frame");
+	if(cobs_decoder_pending(&decoder))
+		fail("streaming decoder pending after last delimiter");
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long iterations = FUZZ_ITERATIONS;
+	unsigned long seed = FUZZ_SEED;
+
+	if(argc > 1)
+		iterations = strtoul(argv[1], NULL, 0);
+	if(argc > 2)
+		seed = strtoul(argv[2], NULL, 0);
+	rng_state = (uint32_t) seed ? (uint32_t) seed : 1;
+
+	for(iteration = 0; iteration < iterations; iteration++)
+	{
+		for(codec = COBS_CODEC_COBS; codec <= COBS_CODEC_ZPE; codec++)
+		{
+			fuzz_payload();
+			expect_length = cobs_ref_codec_encode(codec, payload, length,
+				expect);
+			fuzz_bound();
+			fuzz_encode();
+			fuzz_decode();
+			fuzz_zero_code();
+			fuzz_garbage();
+			fuzz_stream();
+		}
+	}
+
+	printf("cobs_fuzz: %lu iterations, seed 0x%lx, ok\n", iterations, seed);
+	return 0;
+}
@@ -0,0 +1,276 @@
+/* Copyright 2011, Jacques Fortier. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted,
+ * with or without modification.
+ */
+
+#include "cobs_ref.h"
+
+/* Original byte at a time cobs_encode() */
+size_t cobs_ref_encode(const uint8_t * restrict input, size_t length,
+	uint8_t * restrict output)
+{
+    size_t read_index = 0;
+    size_t write_index = 1;
+    size_t code_index = 0;
+    uint8_t code = 1;
+
+    while(read_index < length)
+    {
+        if(input[read_index] == 0)
+        {
+            output[code_index] = code;
+            code = 1;
+            code_index = write_index++;
+            read_index++;
+        }
+        else
+        {
+            output[write_index++] = input[read_index++];
+            code++;
+            if(code == 0xFF)
+            {
+                output[code_index] = code;
+                code = 1;
+                code_index = write_index++;
+            }
+        }
+    }
+
+    output[code_index] = code;
+
+    return write_index;
+}
+
+/* Original byte at a time cobs_decode() */
+size_t cobs_ref_decode(const uint8_t * restrict input, size_t length,
+	uint8_t * restrict output)
+{
+    size_t read_index = 0;
+    size_t write_index = 0;
+    uint8_t code;
+    uint8_t i;
+
+    while(read_index < length)
+    {
+        code = input[read_index];
+
+        if(read_index + code > length && code != 1)
+        {
+            return 0;
+        }
+
+        read_index++;
+
+        for(i = 1; i < code; i++)
+        {
+            output[write_index++] = input[read_index++];
+        }
+        if(code != 0xFF && read_index != length)
+        {
+            output[write_index++] = '\0';
+        }
+    }
+
+    return write_index;
+}
+
+/* COBS/R: COBS, the last byte replaces the final code if greater */
+static size_t cobs_ref_cobsr_encode(const uint8_t *input, size_t length,
+	uint8_t *output)
+{
+    size_t read_index = 0;
+    size_t write_index = 1;
+    size_t code_index = 0;
+    uint8_t code = 1;
+
+    while(read_index < length)
+    {
+        if(input[read_index] == 0)
+        {
+            output[code_index] = code;
+            code = 1;
+            code_index = write_index++;
+            read_index++;
+        }
+        else
+        {
+            output[write_index++] = input[read_index++];
+            code++;
+            if(code == 0xFF)
+            {
+                output[code_index] = code;
+                code = 1;
+                code_index = write_index++;
+            }
+        }
+    }
+
+    if(code > 1 && output[write_index - 1] > code)
+        code = output[--write_index];
+    output[code_index] = code;
+
+    return write_index;
+}
+
+static size_t cobs_ref_cobsr_decode(const uint8_t *input, size_t length,
+	uint8_t *output)
+{
+    size_t read_index = 0;
+    size_t write_index = 0;
+    uint8_t code;
+    uint8_t i;
+
+    while(read_index < length)
+    {
+        code = input[read_index++];
+
+        if(code == 0)
+        {
+            return 0;
+        }
+
+        if(read_index + code - 1 > length)
+        {
+            /* Final block, the code is the last byte */
+            while(read_index < length)
+                output[write_index++] = input[read_index++];
+            output[write_index++] = code;
+            break;
+        }
+
+        for(i = 1; i < code; i++)
+        {
+            output[write_index++] = input[read_index++];
+        }
+        if(code != 0xFF && read_index != length)
+        {
+            output[write_index++] = '\0';
+        }
+    }
+
+    return write_index;
+}
+
+/* COBS/ZPE: 0x01-0xDF - code-1 bytes and a zero, 0xE0 - 223 bytes,
+ * 0xE1-0xFF - code-0xE1 bytes and a pair of zeros.
+ */
+static size_t cobs_ref_zpe_encode(const uint8_t *input, size_t length,
+	uint8_t *output)
+{
+    size_t read_index = 0;
+    size_t write_index = 1;
+    size_t code_index = 0;
+    uint8_t block = 0;
+
+    while(read_index < length)
+    {
+        if(input[read_index] != 0)
+        {
+            output[write_index++] = input[read_index++];
+            block++;
+            if(block == COBS_ZPE_RUN - 1)
+            {
+                output[code_index] = COBS_ZPE_RUN;
+                block = 0;
+                code_index = write_index++;
+            }
+            continue;
+        }
+
+        read_index++;
+        if(block <= 0xFF - COBS_ZPE_PAIR
+            && (read_index == length || input[read_index] == 0))
+        {
+            /* Pair of zeros, a trailing zero pairs with the implicit one */
+            output[code_index] = (uint8_t) (COBS_ZPE_PAIR + block);
+            if(read_index == length)
+                return write_index;
+            read_index++;
+        }
+        else
+            output[code_index] = (uint8_t) (block + 1);
+        block = 0;
+        code_index = write_index++;
+    }
+
+    output[code_index] = (uint8_t) (block + 1);
+
+    return write_index;
+}
+
+static size_t cobs_ref_zpe_decode(const uint8_t *input, size_t length,
+	uint8_t *output)
+{
+    size_t read_index = 0;
+    size_t write_index = 0;
+    uint8_t code;
+    uint8_t data;
+    uint8_t zeros;
+    uint8_t i;
+
+    while(read_index < length)
+    {
+        code = input[read_index++];
+
+        if(code == 0)
+        {
+            return 0;
+        }
+        else if(code < COBS_ZPE_RUN)
+        {
+            data = code - 1;
+            zeros = 1;
+        }
+        else if(code == COBS_ZPE_RUN)
+        {
+            data = COBS_ZPE_RUN - 1;
+            zeros = 0;
+        }
+        else
+        {
+            data = code - COBS_ZPE_PAIR;
+            zeros = 2;
+        }
+
+        if(read_index + data > length)
+        {
+            return 0;
+        }
+
+        for(i = 0; i < data; i++)
+        {
+            output[write_index++] = input[read_index++];
+        }
+        if(read_index == length && zeros != 0)
+        {
+            zeros--;
+        }
+        for(i = 0; i < zeros; i++)
+        {
+            output[write_index++] = '\0';
+        }
+    }
+
+    return write_index;
+}
+
+size_t cobs_ref_codec_encode(cobs_codec_t codec, const uint8_t *input,
+	size_t length, uint8_t *output)
+{
+    if(codec == COBS_CODEC_COBSR)
+        return cobs_ref_cobsr_encode(input, length, output);
+    if(codec == COBS_CODEC_ZPE)
+        return cobs_ref_zpe_encode(input, length, output);
+    return cobs_ref_encode(input, length, output);
+}
+
+size_t cobs_ref_codec_decode(cobs_codec_t codec, const uint8_t *input,
+	size_t length, uint8_t *output)
+{
+    if(codec == COBS_CODEC_COBSR)
+        return cobs_ref_cobsr_decode(input, length, output);
+    if(codec == COBS_CODEC_ZPE)
+        return cobs_ref_zpe_decode(input, length, output);
+    return cobs_ref_decode(input, length, output);
+}
@@ -0,0 +1,26 @@
+#ifndef COBS_REF_H
+#define COBS_REF_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "cobs.h"
+
+/* Byte at a time reference model of the codecs of cobs.c. COBS is the
+ * original Fortier code the word kernels replaced, COBS/R and COBS/ZPE
+ * follow the block definitions directly.
+ */
+
+size_t cobs_ref_encode(const uint8_t * restrict input, size_t length,
+	uint8_t * restrict output);
+
+size_t cobs_ref_decode(const uint8_t * restrict input, size_t length,
+	uint8_t * restrict output);
+
+size_t cobs_ref_codec_encode(cobs_codec_t codec, const uint8_t *input,
+	size_t length, uint8_t *output);
+
+size_t cobs_ref_codec_decode(cobs_codec_t codec, const uint8_t *input,
+	size_t length, uint8_t *output);
+
+#endif /* COBS_REF_H */